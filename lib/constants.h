@@ -24,6 +24,12 @@
 
 #ifndef CONSTANTS_H
 
+// Where time zone files are installed.
+#define ZONE_DIR "/usr/share/zoneinfo"
+
+static const int64_t nsecs_per_sec = 1000000000;
+static const int64_t usecs_per_sec = 1000000;
+
 static const int64_t secs_per_min = 60;
 static const int64_t mins_per_hour = 60;
 static const int64_t secs_per_hour = mins_per_hour * secs_per_min;
@@ -39,6 +45,7 @@ static const int64_t days_per_ncentury = 100 * days_per_nyear + 100 / 4 - 1;
 static const int64_t days_per_400_years = 400 * days_per_nyear + 400 / 4 - 4 + 1;
 static const int64_t secs_per_400_years = days_per_400_years * secs_per_day;
 static const int64_t avg_secs_per_year = secs_per_400_years / 400;
+static const int64_t avg_secs_per_half_year = avg_secs_per_year / 2;
 
 static const int month_starts[2][13] = {
     { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 },
@@ -19,21 +19,63 @@
 // OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
 // WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <inttypes.h>
+#include <string.h>
 #include <errno.h>
 #include "constants.h"
 #include "tz64.h"
 #include "tz64file.h"
 
+// The number of timestamps whose transitions are searched for in
+// lockstep by the batch functions.
+#define BATCH_WIDTH 8
+
+// The number of timestamps the batch functions look up before
+// breaking them down.
+#define BATCH_CHUNK 64
+
+// How many rows ahead tz64_ts_to_tm_mixed prefetches each row's zone
+// header, then the bucket covering its timestamp, then the transition
+// that bucket points at.  Each stage needs the line fetched by the one
+// before it, so they're spaced far enough apart for a miss to resolve.
+#define MIXED_HEADER_AHEAD 12
+#define MIXED_BUCKET_AHEAD 8
+#define MIXED_TRANS_AHEAD 4
+
+// The time zone designation the UTC functions give.
+static const char utc_desig[] = "UTC";
+
+// Compile a function for AVX-512 and AVX2 as well as the baseline
+// architecture, and pick the best the CPU supports at load time.
+#ifdef HAVE_TARGET_CLONES
+#define MULTIVERSIONED __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define MULTIVERSIONED
+#endif
+
+
+// Make sure a time zone is ready to use, decoding it first if it was
+// loaded lazily.  Returns zero and sets errno if it can't be decoded.
+static inline int tz_ready(const struct tz64 *tz)
+{
+    return __builtin_expect(__atomic_load_n(&tz->pending, __ATOMIC_ACQUIRE) == 0, 1) ||
+        tz_load_lazy(tz) == 0;
+}
 
-static inline int64_t populate_ymd(struct tm *tm, int64_t days)
+
+// Split a number of days since the start of a 400-year block into the
+// year within the block and the day within the year.  The year is
+// returned counting the block's first year as 1 so that it can be used
+// for leap calculations.
+static inline int64_t split_days(int64_t *days_inout)
 {
     // Pretend the year is 1 so we can use it for leap calculations.
     int64_t year = 1;
-
-    // Every block of 400 days starts on the same day of the week, and
-    // 2001-01-01 was a Monday.  Compute the day of the week.
-    tm->tm_wday = (days + 1) % days_per_week;
+    int64_t days = *days_inout;
 
     // Subtract to get within one century.  Due to our choice of
     // reference time, the leap year that divides by 100 is the last
@@ -53,15 +95,34 @@ static inline int64_t populate_ymd(struct tm *tm, int64_t days)
     year += y;
     days -= (y * days_per_nyear) + y / 4;
 
-    tm->tm_yday = days;
+    *days_inout = days;
+    return year;
+}
 
-    int leap = is_leap(year);
-    tm->tm_mon = days / 32;
-    if (days >= month_starts[leap][tm->tm_mon + 1]) {
-        tm->tm_mon++;
+
+// Find the month (counting from 0) and day of the month of a day of
+// the year.
+static inline void split_yday(int yday, int leap, int *mon, int *mday)
+{
+    int m = yday / 32;
+    if (yday >= month_starts[leap][m + 1]) {
+        m++;
     }
 
-    tm->tm_mday = days - month_starts[leap][tm->tm_mon] + 1;
+    *mon = m;
+    *mday = yday - month_starts[leap][m] + 1;
+}
+
+
+static inline int64_t populate_ymd(struct tm *tm, int64_t days)
+{
+    // Every block of 400 days starts on the same day of the week, and
+    // 2001-01-01 was a Monday.  Compute the day of the week.
+    tm->tm_wday = (days + 1) % days_per_week;
+
+    int64_t year = split_days(&days);
+    tm->tm_yday = days;
+    split_yday(days, is_leap(year), &tm->tm_mon, &tm->tm_mday);
     return year - 1;
 }
 
@@ -94,7 +155,7 @@ static int64_t ts_to_tm_utc(struct tm *tm, int64_t ts)
 
     year += populate_ymd(tm, ts);
     tm->tm_year = year - base_year;
-    return year + populate_ymd(tm, ts);
+    return year;
 }
 
 
@@ -140,7 +201,9 @@ static int64_t tm_utc_to_ts(const struct tm *tm)
 
 static int64_t expand_ts(const int32_t *timestamps, int i)
 {
-    return tz64_year_starts[i / 2] + timestamps[tz64_year_types[i / 2] * 2 + (i & 1)];
+    // Round down so that transition -1 is in year -1.
+    const int year = (i - (i & 1)) / 2;
+    return tz64_year_starts[year] + timestamps[tz64_year_types[year] * 2 + (i & 1)];
 }
 
 
@@ -160,11 +223,34 @@ static uint32_t find_fwd_index(const int64_t *timestamps, uint32_t count, int64_
 }
 
 
-static int find_extra_fwd_index(const int32_t *timestamps, int64_t adj_ts)
+// Look up transition i of the rule table, using the expanded table if
+// there is one.
+static inline int64_t extra_trans(const struct tz64 *restrict tz, int i)
+{
+    if (tz->extra_cycle != NULL) {
+        return i * avg_secs_per_half_year + tz->extra_cycle[i];
+    }
+
+    return expand_ts(tz->extra_ts, i);
+}
+
+
+static int find_extra_fwd_index(const struct tz64 *restrict tz, int64_t adj_ts)
 {
     int i = adj_ts / avg_secs_per_year * 2;
+
+    // The estimated year is never more than a couple of transitions
+    // out, so with the expanded table we can just count them.
+    if (tz->extra_cycle != NULL) {
+        return i +
+            (adj_ts >= extra_trans(tz, i)) +
+            (adj_ts >= extra_trans(tz, i + 1)) +
+            (adj_ts >= extra_trans(tz, i + 2)) +
+            (adj_ts >= extra_trans(tz, i + 3));
+    }
+
     for (; i < 800; i++) {
-        if (adj_ts < expand_ts(timestamps, i)) {
+        if (adj_ts < expand_ts(tz->extra_ts, i)) {
             break;
         }
     }
@@ -173,35 +259,126 @@ static int find_extra_fwd_index(const int32_t *timestamps, int64_t adj_ts)
 }
 
 
+// Find the latest of count timestamps no later than ts using their
+// Eytzinger layout.  The descent is branch-free and prefetches the
+// cache line holding the current node's great-great-grandchildren.
+static inline uint32_t find_eytz_index(const struct tz_eytzinger *restrict eytz, uint32_t count, int64_t ts)
+{
+    const int64_t *values = eytz->values;
+    uint32_t k = 1;
+    while (k <= count) {
+        __builtin_prefetch(values + k * 16);
+        k = 2 * k + (values[k] <= ts);
+    }
+
+    // Backtrack to the first value later than ts, or 0 if there's no
+    // such value, and look up its predecessor's index.
+    k >>= __builtin_ffs(~k);
+    return eytz->rank[k] - 1;
+}
+
+
+// Find the latest of count timestamps no later than ts, using the
+// Eytzinger layout if there is one.
+static inline uint32_t search_index(const int64_t *timestamps, const struct tz_eytzinger *restrict eytz,
+                                    uint32_t count, int64_t ts)
+{
+    if (eytz->values != NULL) {
+        return find_eytz_index(eytz, count, ts);
+    }
+
+    return find_fwd_index(timestamps, count, ts);
+}
+
+
 static uint32_t find_rev_leap(const struct tz64 *restrict tz, int64_t ymdhm)
 {
-    uint32_t lo = 0, hi = tz->leap_count - 1;
-    while (lo < hi) {
-        uint32_t i = (lo + hi + 1) / 2;
-        if (tz->rev_leap_ts[i] <= ymdhm) {
-            lo = i;
-        } else {
-            hi = i - 1;
+    return search_index(tz->rev_leap_ts, &tz->rev_leap_eytz, tz->leap_count, ymdhm);
+}
+
+
+// Find the latest transition no later than ts, which must be earlier
+// than the last transition.  Timestamps covered by the bucket index
+// start from the bucket's transition; the rest are searched for.
+static inline uint32_t find_ts_index(const struct tz64 *restrict tz, int64_t ts)
+{
+    const struct tz_bucket_index *buckets = &tz->buckets;
+    if (buckets->begin <= ts && ts < buckets->end) {
+        uint32_t i = buckets->fwd[(ts - buckets->begin) >> buckets->shift];
+        while (tz->timestamps[i + 1] <= ts) {
+            i++;
         }
+
+        return i;
     }
 
-    return lo;
+    return search_index(tz->timestamps, &tz->ts_eytz, tz->ts_count, ts);
 }
 
 
-static uint32_t find_rev_index(const struct tz64* restrict tz, int64_t ts)
+// Find the latest timestamp no later than ts, starting from the
+// answer to a previous search.  If ts falls within the same interval
+// or one of its neighbours then no search is needed.
+static inline uint32_t step_fwd_index(const int64_t *timestamps, const struct tz_eytzinger *restrict eytz,
+                                      uint32_t count, uint32_t i, int64_t ts)
 {
-    uint32_t lo = 0, hi = tz->ts_count - 1;
-    while (lo < hi) {
-        uint32_t i = (lo + hi + 1) / 2;
-        if (tz->timestamps[i] <= ts - tz->offsets[tz->offset_map[i]].utoff) {
-            lo = i;
-        } else {
-            hi = i - 1;
+    if (i < count && timestamps[i] <= ts) {
+        if (i + 1 == count || ts < timestamps[i + 1]) {
+            return i;
+        }
+
+        if (i + 2 == count || ts < timestamps[i + 2]) {
+            return i + 1;
         }
+    } else if (0 < i && i < count && timestamps[i - 1] <= ts) {
+        return i - 1;
     }
 
-    return lo;
+    return search_index(timestamps, eytz, count, ts);
+}
+
+
+// Find the latest local-time edge no later than ts, which must be
+// earlier than the last transition's local time.
+static inline uint32_t find_local_edge(const struct tz64 *restrict tz, int64_t ts)
+{
+    const struct tz_bucket_index *buckets = &tz->buckets;
+    if (buckets->begin <= ts && ts < buckets->end) {
+        uint32_t k = buckets->rev[(ts - buckets->begin) >> buckets->shift];
+        while (tz->local_edges[k + 1] <= ts) {
+            k++;
+        }
+
+        return k;
+    }
+
+    return find_fwd_index(tz->local_edges, 2 * tz->ts_count, ts);
+}
+
+
+// As step_fwd_index, but for the local-time edges.  Moving from one
+// transition to the next crosses two edges, so look that far ahead.
+static inline uint32_t step_local_edge(const struct tz64 *restrict tz, uint32_t k, int64_t ts)
+{
+    const int64_t *edges = tz->local_edges;
+    const uint32_t count = 2 * tz->ts_count;
+    if (k < count && edges[k] <= ts) {
+        if (k + 1 == count || ts < edges[k + 1]) {
+            return k;
+        }
+
+        if (k + 2 == count || ts < edges[k + 2]) {
+            return k + 1;
+        }
+
+        if (k + 3 == count || ts < edges[k + 3]) {
+            return k + 2;
+        }
+    } else if (0 < k && k < count && edges[k - 1] <= ts) {
+        return k - 1;
+    }
+
+    return find_local_edge(tz, ts);
 }
 
 
@@ -220,6 +397,16 @@ static int find_extra_rev_index(const struct tz64* restrict tz, int64_t adj_ts)
 {
     int i = (adj_ts / avg_secs_per_year) * 2;
 
+    if (tz->extra_cycle != NULL) {
+        const int32_t even = tz->offsets[tz->offset_map[-2]].utoff;
+        const int32_t odd = tz->offsets[tz->offset_map[-1]].utoff;
+        return i - 1 +
+            (adj_ts - even >= extra_trans(tz, i)) +
+            (adj_ts - odd >= extra_trans(tz, i + 1)) +
+            (adj_ts - even >= extra_trans(tz, i + 2)) +
+            (adj_ts - odd >= extra_trans(tz, i + 3));
+    }
+
     for (; i < 800; i++) {
         if (adj_ts - tz->offsets[tz->offset_map[(i & 1) - 2]].utoff < expand_ts(tz->extra_ts, i)) {
             break;
@@ -230,42 +417,39 @@ static int find_extra_rev_index(const struct tz64* restrict tz, int64_t adj_ts)
 }
 
 
-struct tm *tz64_ts_to_tm(const struct tz64* restrict tz, int64_t ts, struct tm *restrict tm)
+// Count the leap seconds that have elapsed by ts, not including ts
+// itself if it is a leap second; *extra is set to 1 in that case.
+static inline int32_t fwd_leap_secs(const struct tz64 *restrict tz, int64_t ts, int32_t *extra)
 {
-    // Don't even bother if we know the year will overflow 32 bits.
-    if (ts < min_tm_ts || ts > max_tm_ts) {
-        errno = EOVERFLOW;
-        return NULL;
-    }
+    const uint32_t li = search_index(tz->leap_ts, &tz->leap_eytz, tz->leap_count, ts);
+    *extra = (tz->leap_ts[li] - 60 < ts && ts <= tz->leap_ts[li]) ? 1 : 0;
+    return tz->leap_secs[li] - *extra;
+}
 
-    // Figure out how many leap seconds we're dealing wih.
-    int32_t lsec = 0, extra = 0;
-    if (tz->leap_count != 0) {
-        const uint32_t li = find_fwd_index(tz->leap_ts, tz->leap_count, ts);
-        extra = (tz->leap_ts[li] - 60 < ts && ts <= tz->leap_ts[li]) ? 1 : 0;
-        lsec = tz->leap_secs[li] - extra;
+
+// Find the offset that applies to a timestamp no earlier than the
+// last explicit transition.
+static inline const struct tz_offset *extra_fwd_offset(const struct tz64 *restrict tz, int64_t ts)
+{
+    if (tz->extra_ts == NULL) {
+        return &tz->offsets[tz->offset_map[tz->ts_count - 1]];
     }
 
-    // Figure out which offset to apply.
-    const struct tz_offset *offset;
-    if (ts < tz->timestamps[tz->ts_count - 1]) {
-        // Do a binary search to find the index of latest timestamp no
-        // later than t, and adjust the timestamp.
-        const uint32_t i = find_fwd_index(tz->timestamps, tz->ts_count, ts);
-        offset = &tz->offsets[tz->offset_map[i]];
-    } else if (tz->extra_ts == NULL) {
-        offset = &tz->offsets[tz->offset_map[tz->ts_count - 1]];
-    } else {
-        // Adjust the timestamp to seconds since 2001-01-01 00:00:00.
-        int64_t adj_ts = calc_adj_ts(ts);
+    // Adjust the timestamp to seconds since 2001-01-01 00:00:00 and
+    // bisect to find the offset that applies.
+    const int i = find_extra_fwd_index(tz, calc_adj_ts(ts));
+    return &tz->offsets[tz->offset_map[((i + 1) & 1) - 2]];
+}
 
-        // Bisect to find the offset that applies.
-        const int i = find_extra_fwd_index(tz->extra_ts, adj_ts);
-        offset = &tz->offsets[tz->offset_map[((i + 1) & 1) - 2]];
-    }
 
+// Fill in a struct tm given a timestamp already adjusted to local
+// time and the offset that was used to adjust it.
+static inline struct tm *fill_tm(const struct tz64 *restrict tz, int64_t local,
+                                 const struct tz_offset *offset, int32_t extra,
+                                 struct tm *restrict tm)
+{
     // Convert that to broken-down time as if it were UTC.
-    int64_t year = ts_to_tm_utc(tm, ts + offset->utoff - lsec - extra);
+    int64_t year = ts_to_tm_utc(tm, local);
 
     // Bump the second up to 60 if appropriate.
     tm->tm_sec += extra;
@@ -285,186 +469,2103 @@ struct tm *tz64_ts_to_tm(const struct tz64* restrict tz, int64_t ts, struct tm *
 }
 
 
-static void clamp(int *value, int64_t *overflow, int max)
+// Find the offset in effect at a timestamp, ignoring leap seconds.
+static inline const struct tz_offset *trans_offset(const struct tz64 *restrict tz, int64_t ts)
 {
-    *overflow += *value;
-    *value = *overflow % max;
-    *overflow /= max;
-    if (*value < 0) {
-        *value += max;
-        *overflow -= 1;
+    if (ts < tz->timestamps[tz->ts_count - 1]) {
+        // Search for the index of latest timestamp no later than t.
+        const uint32_t i = find_ts_index(tz, ts);
+        return &tz->offsets[tz->offset_map[i]];
     }
+
+    return extra_fwd_offset(tz, ts);
 }
 
 
-static int64_t canonicalize_tm(struct tm *tm)
+// Look up the offset and leap seconds that apply at ts.
+static inline const struct tz_offset *fwd_offset(const struct tz64 *restrict tz, int64_t ts,
+                                                 int32_t *restrict lsec, int32_t *restrict extra)
 {
-    // Convert to the time to canonical form.
-    int64_t overflow = 0;
-    clamp(&tm->tm_sec, &overflow, secs_per_min);
-    clamp(&tm->tm_min, &overflow, mins_per_hour);
-    clamp(&tm->tm_hour, &overflow, hours_per_day);
+    // Figure out how many leap seconds we're dealing wih.
+    *lsec = 0;
+    *extra = 0;
+    if (tz->leap_count != 0) {
+        *lsec = fwd_leap_secs(tz, ts, extra);
+    }
 
-    // Convert the year, month and day to days since the beginning of
-    // 1 AD.
-    int64_t days = daynum(tm->tm_year + base_year, tm->tm_mon + 1, tm->tm_mday) + overflow;
-    days -= 1;
+    // Figure out which offset to apply.
+    return trans_offset(tz, ts);
+}
 
-    // Convert days into 400 year blocks and extra.
-    int64_t year = 1 + 400 * (days / days_per_400_years);
-    days %= days_per_400_years;
-    if (days < 0) {
-        days += days_per_400_years;
-        year -= 400;
+
+struct tm *tz64_ts_to_tm(const struct tz64* restrict tz, int64_t ts, struct tm *restrict tm)
+{
+    if (!tz_ready(tz)) {
+        return NULL;
     }
 
-    year += populate_ymd(tm, days);
-    tm->tm_year = year - base_year;
+    // Don't even bother if we know the year will overflow 32 bits.
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
 
-    return year;
+    int32_t lsec, extra;
+    const struct tz_offset *offset = fwd_offset(tz, ts, &lsec, &extra);
+    return fill_tm(tz, ts + offset->utoff - lsec - extra, offset, extra, tm);
 }
 
 
-int64_t tz64_tm_to_ts(const struct tz64 *tz, struct tm *tm)
+// Fill in the parts of a struct tm that are the same for every UTC
+// time.
+static inline void fill_utc(struct tm *tm)
 {
-    // Sequester the seconds when dealing with time zones that support
-    // leap seconds.
-    int sec = tm->tm_sec;
-    if (tz->leap_count != 0) {
-        tm->tm_sec = 0;
+    tm->tm_isdst = 0;
+    tm->tm_gmtoff = 0;
+    tm->tm_zone = utc_desig;
+}
+
+
+struct tm *tz64_gmtime(int64_t ts, struct tm *restrict tm)
+{
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
     }
 
-    // Try to convert tm to canonical form.  If the tm overflows then
-    // return -1.
-    int64_t year = canonicalize_tm(tm);
-    if (year - base_year != tm->tm_year) {
-        tm->tm_sec = sec;
-        return -1;
+    const int64_t year = ts_to_tm_utc(tm, ts);
+    fill_utc(tm);
+    if (year - base_year < INT32_MIN || year - base_year > INT32_MAX) {
+        errno = EOVERFLOW;
+        return NULL;
     }
 
-    // Convert that to a timestamp as if it were UTC.
-    int64_t ts = tm_utc_to_ts(tm);
+    return tm;
+}
 
-    // Restore the seconds if necessary.
-    int recalc = 0;
-    int64_t leap_ts = 0;
-    int32_t lsec = 0;
-    if (tz->leap_count != 0) {
-        tm->tm_sec = sec;
-        ts += sec;
-        recalc = (sec < 0 || sec > 59) ? 1 : 0;
 
-        // Adjust for leap seconds.
-        uint32_t li = find_rev_leap(tz, encode_ymdhm(tm));
-        lsec = tz->leap_secs[li];
-        ts += lsec;
-        leap_ts = (li + 1 < tz->leap_count) ? tz->leap_ts[li + 1] : INT64_MAX;
+// Fill in the fields selected by mask given a timestamp already
+// adjusted to local time and the offset that was used to adjust it.
+static struct tz64_fields *fill_fields(const struct tz64 *restrict tz, int64_t local,
+                                       const struct tz_offset *offset, int32_t extra,
+                                       struct tz64_fields *restrict fields, unsigned int mask)
+{
+    // Adjust to seconds since 2001-01-01 and split into 400-year
+    // blocks, days and seconds, as in ts_to_tm_utc.
+    local -= alt_ref_ts;
+    int64_t year = alt_ref_year + 400 * (local / secs_per_400_years);
+    local %= secs_per_400_years;
+    if (local < 0) {
+        year -= 400;
+        local += secs_per_400_years;
     }
 
-    // Find the latest offset that contains the timestamp.
-    const struct tz_offset *offset, *prev_offset, *next_offset;
-    int64_t curr_ts, next_ts;
-    int64_t curr_trans, next_trans;
-    if (ts - tz->offsets[tz->offset_map[tz->ts_count - 1]].utoff < tz->timestamps[tz->ts_count - 1]) {
-        uint32_t i = find_rev_index(tz, ts);
-        offset = &tz->offsets[tz->offset_map[i]];
-        curr_ts = ts;
-        curr_trans = tz->timestamps[i];
-        prev_offset = (i == 0) ? NULL : &tz->offsets[tz->offset_map[i - 1]];
+    int64_t days = local / secs_per_day;
+    const int32_t secs = local % secs_per_day;
 
-        if (i + 1 < tz->ts_count) {
-            next_offset = &tz->offsets[tz->offset_map[i + 1]];
-            next_ts = ts;
-            next_trans = tz->timestamps[i + 1];
-        } else if (tz->extra_ts == NULL) {
-            next_offset = NULL;
-            next_ts = 0;
-            next_trans = 0;
-        } else {
-            int64_t adj_ts = calc_adj_ts(ts);
-            next_ts = adj_ts;
-            int j = find_extra_rev_index(tz, adj_ts);
-            next_offset = &tz->offsets[tz->offset_map[(j & 1) - 2]];
-            next_trans = expand_ts(tz->extra_ts, j);
-        }
-    } else if (tz->extra_ts == NULL) {
-        uint32_t i = tz->ts_count - 1;
-        offset = &tz->offsets[tz->offset_map[i]];
-        curr_ts = ts;
-        curr_trans = tz->timestamps[i];
-        prev_offset = (i == 0) ? NULL : &tz->offsets[tz->offset_map[i - 1]];
+    if (mask & TZ64_FIELD_TIME) {
+        fields->hour = secs / secs_per_hour;
+        fields->min = secs / secs_per_min % mins_per_hour;
+        fields->sec = secs % secs_per_min + extra;
+    }
 
-        next_ts = 0;
-        next_offset = NULL;
-        next_trans = 0;
-    } else {
-        int64_t adj_ts = calc_adj_ts(ts);
-        int i = find_extra_rev_index(tz, adj_ts);
-        offset = &tz->offsets[tz->offset_map[(i & 1) - 2]];
-        curr_ts = adj_ts;
-        curr_trans = expand_ts(tz->extra_ts, i);
+    if (mask & TZ64_FIELD_WDAY) {
+        fields->wday = (days + 1) % days_per_week;
+    }
 
-        next_offset = &tz->offsets[tz->offset_map[((i + 1) & 1) - 2]];
-        next_ts = adj_ts;
-        next_trans = expand_ts(tz->extra_ts, i + 1);
+    if (mask & (TZ64_FIELD_DATE | TZ64_FIELD_YDAY)) {
+        const int64_t y = split_days(&days);
+        year += y - 1;
+        if (year < INT32_MIN || year > INT32_MAX) {
+            errno = EOVERFLOW;
+            return NULL;
+        }
 
-        // Decide if the previous transition is explicit.
-        int64_t diff = curr_trans - expand_ts(tz->extra_ts, i - 1);
-        if (tz->ts_count >= 2 && ts - diff < tz->timestamps[tz->ts_count - 1]) {
-            prev_offset = &tz->offsets[tz->offset_map[tz->ts_count - 2]];
-        } else {
-            prev_offset = &tz->offsets[tz->offset_map[((i + 1) & 1) - 2]];
+        fields->yday = days;
+        if (mask & TZ64_FIELD_DATE) {
+            int mon, mday;
+            split_yday(days, is_leap(y), &mon, &mday);
+            fields->year = year;
+            fields->mon = mon + 1;
+            fields->mday = mday;
         }
     }
 
-    // Cope with problematic timestamps.
-    if (next_offset != NULL && next_ts - offset->utoff >= next_trans) {
-        // The time stamp is both after this offset's range and before
-        // the next one: it's not a real time.  If the DST indicator
-        // matches this one then we assume that something was added to
-        // to a valid struct tm to push it into the next; otherwise
-        // we'll assume subtraction from the next.
-        if (tm->tm_isdst >= 0 && !tm->tm_isdst == !offset->isdst &&
-            !tm->tm_isdst != !next_offset->isdst) {
-            // Adjust the timestamp by the current offset.
-            ts -= offset->utoff;
+    if (mask & TZ64_FIELD_OFFSET) {
+        fields->offset = offset - tz->offsets;
+    }
 
-            // Recompute the broken-down time using the next offset.
-            ts_to_tm_utc(tm, ts + next_offset->utoff);
-            offset = next_offset;
-        } else {
-            // Adjust the timestamp by the next offset.
-            ts -= next_offset->utoff;
+    return fields;
+}
 
-            // Recompute broken-down time using the current offset.
-            recalc = 1;
-        }
-    } else {
-        // If the time could belong in either this offset or the
-        // previous one then consult the dst indicator and, failing
-        // that, the offset from UTC.
-        if (tm->tm_isdst >= 0 && prev_offset != NULL && curr_ts - prev_offset->utoff < curr_trans) {
-            if (!tm->tm_isdst == !prev_offset->isdst &&
-                (!tm->tm_isdst != !offset->isdst || tm->tm_gmtoff == prev_offset->utoff)) {
-                offset = prev_offset;
-            }
-        }
 
-        ts -= offset->utoff;
+struct tz64_fields *tz64_ts_to_fields(const struct tz64 *restrict tz, int64_t ts,
+                                      struct tz64_fields *restrict fields, unsigned int mask)
+{
+    if (!tz_ready(tz)) {
+        return NULL;
     }
 
-    if (recalc) {
-        int extra = (leap_ts != 0 && tm->tm_sec == 60 && leap_ts - 60 <= ts && ts <= leap_ts) ? 1 : 0;
-        ts_to_tm_utc(tm, ts + offset->utoff - lsec - extra);
-        tm->tm_sec += extra;
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
     }
 
-    // We've chosen our offset.  Use it to fill in the remaining
-    // parts of broken-down time.
-    tm->tm_isdst = offset->isdst;
-    tm->tm_gmtoff = offset->utoff;
-    tm->tm_zone = tz->desig + offset->desig;
-    return ts;
+    int32_t lsec, extra;
+    const struct tz_offset *offset = fwd_offset(tz, ts, &lsec, &extra);
+    return fill_fields(tz, ts + offset->utoff - lsec - extra, offset, extra, fields, mask);
+}
+
+
+static inline void fill_offset_info(const struct tz64 *restrict tz, const struct tz_offset *offset,
+                                    struct tz64_offset_info *restrict info)
+{
+    info->utoff = offset->utoff;
+    info->isdst = offset->isdst;
+    info->desig = tz->desig + offset->desig;
+}
+
+
+const struct tz64_offset_info *tz64_offset_at(const struct tz64 *restrict tz, int64_t ts,
+                                              struct tz64_offset_info *restrict info)
+{
+    if (!tz_ready(tz)) {
+        return NULL;
+    }
+
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    // The leap seconds don't affect the offset.
+    fill_offset_info(tz, trans_offset(tz, ts), info);
+    return info;
+}
+
+
+int64_t tz64_ts_to_local(const struct tz64 *restrict tz, int64_t ts)
+{
+    if (!tz_ready(tz)) {
+        return -1;
+    }
+
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    int32_t lsec, extra;
+    const struct tz_offset *offset = fwd_offset(tz, ts, &lsec, &extra);
+    return ts + offset->utoff - lsec - extra;
+}
+
+
+static const struct tz64_transition *fill_transition(const struct tz64 *restrict tz, int64_t ts,
+                                                     const struct tz_offset *before,
+                                                     const struct tz_offset *after,
+                                                     struct tz64_transition *restrict trans)
+{
+    trans->ts = ts;
+    fill_offset_info(tz, before, &trans->before);
+    fill_offset_info(tz, after, &trans->after);
+    return trans;
+}
+
+
+// Fill in explicit transition i.
+static inline const struct tz64_transition *explicit_transition(const struct tz64 *restrict tz, uint32_t i,
+                                                                struct tz64_transition *restrict trans)
+{
+    return fill_transition(tz, tz->timestamps[i],
+                           &tz->offsets[tz->offset_map[i - 1]],
+                           &tz->offsets[tz->offset_map[i]],
+                           trans);
+}
+
+
+// Fill in transition i of the rule table, where base is the timestamp
+// of the start of the 400-year cycle.
+static inline const struct tz64_transition *rule_transition(const struct tz64 *restrict tz, int64_t base, int i,
+                                                            struct tz64_transition *restrict trans)
+{
+    return fill_transition(tz, base + extra_trans(tz, i),
+                           &tz->offsets[tz->offset_map[((i + 1) & 1) - 2]],
+                           &tz->offsets[tz->offset_map[(i & 1) - 2]],
+                           trans);
+}
+
+
+const struct tz64_transition *tz64_next_transition(const struct tz64 *restrict tz, int64_t ts,
+                                                   struct tz64_transition *restrict trans)
+{
+    if (!tz_ready(tz)) {
+        return NULL;
+    }
+
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    // Before the last explicit transition the next one is explicit.
+    if (ts < tz->timestamps[tz->ts_count - 1]) {
+        return explicit_transition(tz, find_ts_index(tz, ts) + 1, trans);
+    }
+
+    if (tz->extra_ts == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    // Otherwise find the first rule transition after ts.  Index 800
+    // is the first transition of the next cycle.
+    const int64_t adj_ts = calc_adj_ts(ts);
+    return rule_transition(tz, ts - adj_ts, find_extra_fwd_index(tz, adj_ts), trans);
+}
+
+
+const struct tz64_transition *tz64_prev_transition(const struct tz64 *restrict tz, int64_t ts,
+                                                   struct tz64_transition *restrict trans)
+{
+    if (!tz_ready(tz)) {
+        return NULL;
+    }
+
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    const uint32_t last = tz->ts_count - 1;
+    if (ts < tz->timestamps[last]) {
+        const uint32_t i = find_ts_index(tz, ts);
+        if (i == 0) {
+            errno = ENOENT;
+            return NULL;
+        }
+
+        return explicit_transition(tz, i, trans);
+    }
+
+    // Find the latest rule transition no later than ts, going back a
+    // cycle if needs be, unless the last explicit transition is later.
+    if (tz->extra_ts != NULL) {
+        const int64_t adj_ts = calc_adj_ts(ts);
+        int64_t base = ts - adj_ts;
+        int i = find_extra_fwd_index(tz, adj_ts) - 1;
+        if (i < 0) {
+            i += 800;
+            base -= secs_per_400_years;
+        }
+
+        if (tz->timestamps[last] < base + extra_trans(tz, i)) {
+            return rule_transition(tz, base, i, trans);
+        }
+    }
+
+    if (last == 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    return explicit_transition(tz, last, trans);
+}
+
+
+void tz64_transition_iter_init(struct tz64_transition_iter *iter, const struct tz64 *tz,
+                               int64_t begin, int64_t end)
+{
+    iter->tz = tz;
+    iter->ts = (begin > min_tm_ts) ? begin - 1 : min_tm_ts;
+    iter->end = end;
+}
+
+
+const struct tz64_transition *tz64_transition_iter_next(struct tz64_transition_iter *restrict iter,
+                                                        struct tz64_transition *restrict trans)
+{
+    if (iter->ts >= iter->end) {
+        return NULL;
+    }
+
+    const int saved_errno = errno;
+    if (tz64_next_transition(iter->tz, iter->ts, trans) == NULL || trans->ts >= iter->end) {
+        errno = saved_errno;
+        iter->ts = iter->end;
+        return NULL;
+    }
+
+    iter->ts = trans->ts;
+    return trans;
+}
+
+
+void tz64_cursor_init(struct tz64_cursor *cursor, const struct tz64 *tz)
+{
+    cursor->tz = tz;
+    cursor->fwd_index = 0;
+    cursor->leap_index = 0;
+    cursor->rev_index = 0;
+    cursor->rev_leap_index = 0;
+}
+
+
+// Look up the offset and leap seconds that apply at ts, starting from
+// where the cursor's last lookup left off.
+static inline const struct tz_offset *cursor_fwd_offset(struct tz64_cursor *restrict cursor, int64_t ts,
+                                                        int32_t *restrict lsec, int32_t *restrict extra)
+{
+    const struct tz64 *tz = cursor->tz;
+
+    *lsec = 0;
+    *extra = 0;
+    if (tz->leap_count != 0) {
+        const uint32_t li = step_fwd_index(tz->leap_ts, &tz->leap_eytz, tz->leap_count, cursor->leap_index, ts);
+        cursor->leap_index = li;
+        *extra = (ts == tz->leap_ts[li]) ? 1 : 0;
+        *lsec = tz->leap_secs[li] - *extra;
+    }
+
+    if (ts < tz->timestamps[tz->ts_count - 1]) {
+        const uint32_t i = step_fwd_index(tz->timestamps, &tz->ts_eytz, tz->ts_count, cursor->fwd_index, ts);
+        cursor->fwd_index = i;
+        return &tz->offsets[tz->offset_map[i]];
+    }
+
+    return extra_fwd_offset(tz, ts);
+}
+
+
+struct tm *tz64_cursor_ts_to_tm(struct tz64_cursor *restrict cursor, int64_t ts, struct tm *restrict tm)
+{
+    if (!tz_ready(cursor->tz)) {
+        return NULL;
+    }
+
+    // Don't even bother if we know the year will overflow 32 bits.
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    int32_t lsec, extra;
+    const struct tz_offset *offset = cursor_fwd_offset(cursor, ts, &lsec, &extra);
+    return fill_tm(cursor->tz, ts + offset->utoff - lsec - extra, offset, extra, tm);
+}
+
+
+// Find the latest transition no later than each of n timestamps.
+// The searches run in lockstep and without branches so that their
+// loads overlap instead of each one waiting on the last, and the
+// candidates for the next round are prefetched while the current
+// round's comparisons resolve.
+static void find_fwd_indexes(const int64_t *restrict timestamps, uint32_t count,
+                             const int64_t *restrict ts, uint32_t *restrict index, int n)
+{
+    for (int j = 0; j < n; j++) {
+        index[j] = 0;
+    }
+
+    uint32_t len = count;
+    while (len > 1) {
+        const uint32_t half = len / 2;
+        const uint32_t next = (len - half) / 2;
+        for (int j = 0; j < n; j++) {
+            __builtin_prefetch(&timestamps[index[j] + next]);
+            __builtin_prefetch(&timestamps[index[j] + half + next]);
+        }
+
+        for (int j = 0; j < n; j++) {
+            index[j] += (timestamps[index[j] + half] <= ts[j]) ? half : 0;
+        }
+
+        len -= half;
+    }
+}
+
+
+// Look up the offset that applies to each of count timestamps and use
+// it to adjust the timestamp to local time.  If local and extra are
+// NULL then only the offsets are looked up, skipping the leap seconds.
+// Returns the number of timestamps looked up, which is less than count
+// only if one of them can't be converted.
+static size_t lookup_fwd(const struct tz64 *restrict tz, const int64_t *restrict ts, size_t count,
+                         const struct tz_offset **restrict offset, int64_t *restrict local,
+                         int32_t *restrict extra)
+{
+    // Hoist everything that depends only on the time zone.
+    const int64_t *const timestamps = tz->timestamps;
+    const uint32_t ts_count = tz->ts_count;
+    const int64_t last_ts = timestamps[ts_count - 1];
+    const int has_leaps = tz->leap_count != 0 && local != NULL;
+    const int64_t index_begin = tz->buckets.begin;
+    const int64_t index_end = (tz->buckets.end < last_ts) ? tz->buckets.end : last_ts;
+
+    uint32_t index[BATCH_WIDTH];
+    for (size_t base = 0; base < count; base += BATCH_WIDTH) {
+        const int n = (count - base < BATCH_WIDTH) ? count - base : BATCH_WIDTH;
+
+        // Only search if some timestamp needs a transition that isn't
+        // covered by the bucket index.
+        int search = 0;
+        for (int j = 0; j < n; j++) {
+            const int64_t t = ts[base + j];
+            if (index_begin <= t && t < index_end) {
+                index[j] = find_ts_index(tz, t);
+            } else if (t < last_ts) {
+                search = 1;
+            }
+        }
+
+        if (search) {
+            find_fwd_indexes(timestamps, ts_count, ts + base, index, n);
+        }
+
+        for (int j = 0; j < n; j++) {
+            const size_t k = base + j;
+            const int64_t t = ts[k];
+            if (t < min_tm_ts || t > max_tm_ts) {
+                errno = EOVERFLOW;
+                return k;
+            }
+
+            offset[k] = (t < last_ts) ?
+                &tz->offsets[tz->offset_map[index[j]]] :
+                extra_fwd_offset(tz, t);
+            if (local == NULL) {
+                continue;
+            }
+
+            int32_t lsec = 0;
+            extra[k] = 0;
+            if (has_leaps) {
+                lsec = fwd_leap_secs(tz, t, &extra[k]);
+            }
+
+            local[k] = t + offset[k]->utoff - lsec - extra[k];
+        }
+    }
+
+    return count;
+}
+
+
+// As above, but using a cursor rather than searching afresh for each
+// timestamp.
+static size_t lookup_fwd_cursor(struct tz64_cursor *restrict cursor, const int64_t *restrict ts, size_t count,
+                                const struct tz_offset **restrict offset, int64_t *restrict local,
+                                int32_t *restrict extra)
+{
+    for (size_t k = 0; k < count; k++) {
+        const int64_t t = ts[k];
+        if (t < min_tm_ts || t > max_tm_ts) {
+            errno = EOVERFLOW;
+            return k;
+        }
+
+        int32_t lsec;
+        offset[k] = cursor_fwd_offset(cursor, t, &lsec, &extra[k]);
+        local[k] = t + offset[k]->utoff - lsec - extra[k];
+    }
+
+    return count;
+}
+
+
+// Start fetching the parts of a zone's header that fwd_offset reads.
+static inline void prefetch_header(const struct tz64 *restrict tz)
+{
+    __builtin_prefetch(&tz->ts_count);
+    __builtin_prefetch(&tz->buckets);
+}
+
+
+// With the header in cache, start fetching the bucket that covers ts,
+// or the last transition if ts isn't covered.  There's nothing to
+// fetch for a time zone that hasn't been decoded yet.
+static inline void prefetch_bucket(const struct tz64 *restrict tz, int64_t ts)
+{
+    if (__atomic_load_n(&tz->pending, __ATOMIC_ACQUIRE) != 0) {
+        return;
+    }
+
+    const struct tz_bucket_index *buckets = &tz->buckets;
+    if (buckets->begin <= ts && ts < buckets->end) {
+        __builtin_prefetch(&buckets->fwd[(ts - buckets->begin) >> buckets->shift]);
+    } else {
+        __builtin_prefetch(&tz->timestamps[tz->ts_count - 1]);
+    }
+}
+
+
+// With the bucket in cache, start fetching the transition it points
+// at and that transition's offset.
+static inline void prefetch_trans(const struct tz64 *restrict tz, int64_t ts)
+{
+    if (__atomic_load_n(&tz->pending, __ATOMIC_ACQUIRE) != 0) {
+        return;
+    }
+
+    const struct tz_bucket_index *buckets = &tz->buckets;
+    if (buckets->begin <= ts && ts < buckets->end) {
+        const uint32_t i = buckets->fwd[(ts - buckets->begin) >> buckets->shift];
+        __builtin_prefetch(&tz->timestamps[i]);
+        __builtin_prefetch(&tz->offsets[tz->offset_map[i]]);
+    }
+}
+
+
+// As lookup_fwd, but with each timestamp in its own time zone.  The
+// zones' headers, buckets and transitions are prefetched a few rows
+// ahead, in stages, so that the misses on rows in different zones
+// overlap rather than each lookup waiting on its own.  The arrays
+// are indexed from base, and rows up to total are prefetched.
+static size_t lookup_fwd_mixed(const struct tz64 *const *restrict zones, const int64_t *restrict ts,
+                               size_t base, size_t count, size_t total,
+                               const struct tz_offset **restrict offset, int64_t *restrict local,
+                               int32_t *restrict extra)
+{
+    for (size_t j = 0; j < count; j++) {
+        const size_t k = base + j;
+        if (k + MIXED_HEADER_AHEAD < total) {
+            prefetch_header(zones[k + MIXED_HEADER_AHEAD]);
+        }
+        if (k + MIXED_BUCKET_AHEAD < total) {
+            prefetch_bucket(zones[k + MIXED_BUCKET_AHEAD], ts[k + MIXED_BUCKET_AHEAD]);
+        }
+        if (k + MIXED_TRANS_AHEAD < total) {
+            prefetch_trans(zones[k + MIXED_TRANS_AHEAD], ts[k + MIXED_TRANS_AHEAD]);
+        }
+
+        const int64_t t = ts[k];
+        if (t < min_tm_ts || t > max_tm_ts) {
+            errno = EOVERFLOW;
+            return j;
+        }
+
+        if (!tz_ready(zones[k])) {
+            return j;
+        }
+
+        int32_t lsec;
+        offset[j] = fwd_offset(zones[k], t, &lsec, &extra[j]);
+        local[j] = t + offset[j]->utoff - lsec - extra[j];
+    }
+
+    return count;
+}
+
+
+// Broken-down times for a chunk of local timestamps, one array per
+// field.
+struct chunk_fields {
+    int64_t year[BATCH_CHUNK];
+    int32_t mon[BATCH_CHUNK];
+    int32_t mday[BATCH_CHUNK];
+    int32_t hour[BATCH_CHUNK];
+    int32_t min[BATCH_CHUNK];
+    int32_t sec[BATCH_CHUNK];
+    int32_t yday[BATCH_CHUNK];
+    int32_t wday[BATCH_CHUNK];
+};
+
+
+// Timestamps between kernel_bias seconds before and kernel_limit
+// seconds after 2001-01-01 (roughly 2400 BC to 10700 AD) are broken
+// down by decompose_kernel.  Adding the bias makes them all
+// non-negative, and small enough to be divided down to days in
+// unsigned 32-bit arithmetic.
+static const int64_t kernel_bias = 11 * secs_per_400_years;
+static const int64_t kernel_limit = INT64_C(1) << 38;
+
+
+// Break down a full chunk of local timestamps as if they were UTC,
+// producing the same results as ts_to_tm_utc for timestamps within
+// the kernel's range.  The arithmetic is branch-free and 32 bits wide
+// so that the loop vectorises.
+MULTIVERSIONED
+static void decompose_kernel(const int64_t *restrict local, struct chunk_fields *restrict f)
+{
+    const uint32_t ncentury = days_per_ncentury;
+    const uint32_t block = days_per_400_years;
+
+    for (int j = 0; j < BATCH_CHUNK; j++) {
+        // Split into days and seconds of the day.  A day is 128 * 675
+        // seconds: shifting out the 128 first leaves a quotient that
+        // fits in 32 bits.
+        const uint64_t t = local[j] - alt_ref_ts + kernel_bias;
+        const uint32_t q = t >> 7;
+        uint32_t days = q / 675;
+        uint32_t secs = (q - days * 675) * 128 + (uint32_t)(t & 127);
+
+        // Divide the seconds into hours, minutes and seconds.
+        const uint32_t hour = secs / 3600;
+        secs -= hour * 3600;
+        const uint32_t min = secs / 60;
+        f->hour[j] = hour;
+        f->min[j] = min;
+        f->sec[j] = secs - min * 60;
+
+        // Divide out blocks of 400 years.
+        const uint32_t blocks = days / block;
+        days -= blocks * block;
+
+        // From here it's populate_ymd without the branches.
+        f->wday[j] = (days + 1) % 7;
+
+        uint32_t c = days / ncentury;
+        c = (c < 3) ? c : 3;
+        days -= c * ncentury;
+
+        const uint32_t y = (days * 4 + 3) / 1461;
+        days -= y * 365 + y / 4;
+        f->yday[j] = days;
+
+        // The year is 1 + 100 * c + y within the block.  Rather than
+        // look up month_starts, which would need a gather, count the
+        // days from the 1st of March so that the month lengths follow
+        // a regular pattern.
+        const uint32_t leap = (y % 4 == 3) & ((y != 99) | (c == 3));
+        const uint32_t feb_end = 59 + leap;
+        const uint32_t mdays = (days >= feb_end) ? days - feb_end : days + 306;
+        const uint32_t mp = (mdays * 5 + 2) / 153;
+        f->mon[j] = (mp < 10) ? mp + 3 : mp - 9;
+        f->mday[j] = mdays - (mp * 153 + 2) / 5 + 1;
+
+        f->year[j] = (int64_t)(400 * blocks + 100 * c + y) + alt_ref_year - 400 * 11;
+    }
+}
+
+
+// Break down n local timestamps as if they were UTC.  The local
+// array must have room for a full chunk.
+static void decompose_chunk(int64_t *restrict local, size_t n, struct chunk_fields *restrict f)
+{
+    // Pad out a partial chunk so the kernel can always run in full.
+    for (size_t j = n; j < BATCH_CHUNK; j++) {
+        local[j] = alt_ref_ts;
+    }
+
+    decompose_kernel(local, f);
+
+    // Redo any timestamps outside the kernel's range the slow way.
+    for (size_t j = 0; j < n; j++) {
+        const int64_t adj = local[j] - alt_ref_ts;
+        if (adj < -kernel_bias || adj >= kernel_limit) {
+            struct tm tm;
+            f->year[j] = ts_to_tm_utc(&tm, local[j]);
+            f->mon[j] = tm.tm_mon + 1;
+            f->mday[j] = tm.tm_mday;
+            f->hour[j] = tm.tm_hour;
+            f->min[j] = tm.tm_min;
+            f->sec[j] = tm.tm_sec;
+            f->yday[j] = tm.tm_yday;
+            f->wday[j] = tm.tm_wday;
+        }
+    }
+}
+
+
+// Convert count timestamps to broken-down time, a chunk at a time.
+// If cursor is not NULL then use it to look up the offsets; if zones
+// is not NULL then each timestamp is in its own zone and tz is unused.
+static size_t ts_to_tm_chunks(const struct tz64 *restrict tz, struct tz64_cursor *restrict cursor,
+                              const struct tz64 *const *restrict zones,
+                              const int64_t *restrict ts, struct tm *restrict tm, size_t count)
+{
+    const struct tz_offset *offset[BATCH_CHUNK];
+    int64_t local[BATCH_CHUNK];
+    int32_t extra[BATCH_CHUNK];
+    struct chunk_fields f;
+
+    if (tz != NULL && !tz_ready(tz)) {
+        return 0;
+    }
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+        const size_t m = (zones != NULL) ?
+            lookup_fwd_mixed(zones, ts, base, n, count, offset, local, extra) :
+            (cursor == NULL) ?
+            lookup_fwd(tz, ts + base, n, offset, local, extra) :
+            lookup_fwd_cursor(cursor, ts + base, n, offset, local, extra);
+        decompose_chunk(local, m, &f);
+
+        for (size_t j = 0; j < m; j++) {
+            if (f.year[j] - base_year < INT32_MIN || f.year[j] - base_year > INT32_MAX) {
+                errno = EOVERFLOW;
+                return base + j;
+            }
+
+            struct tm *out = &tm[base + j];
+            out->tm_sec = f.sec[j] + extra[j];
+            out->tm_min = f.min[j];
+            out->tm_hour = f.hour[j];
+            out->tm_mday = f.mday[j];
+            out->tm_mon = f.mon[j] - 1;
+            out->tm_year = f.year[j] - base_year;
+            out->tm_wday = f.wday[j];
+            out->tm_yday = f.yday[j];
+            out->tm_isdst = offset[j]->isdst;
+            out->tm_gmtoff = offset[j]->utoff;
+            out->tm_zone = ((zones != NULL) ? zones[base + j] : tz)->desig + offset[j]->desig;
+        }
+
+        if (m < n) {
+            return base + m;
+        }
+    }
+
+    return count;
+}
+
+
+size_t tz64_ts_to_tm_batch(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                           struct tm *restrict tm, size_t count)
+{
+    return ts_to_tm_chunks(tz, NULL, NULL, ts, tm, count);
+}
+
+
+size_t tz64_ts_to_tm_sorted(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                            struct tm *restrict tm, size_t count)
+{
+    struct tz64_cursor cursor;
+    tz64_cursor_init(&cursor, tz);
+    return ts_to_tm_chunks(tz, &cursor, NULL, ts, tm, count);
+}
+
+
+size_t tz64_ts_to_tm_mixed(const struct tz64 *const *restrict zones, const int64_t *restrict ts,
+                           struct tm *restrict tm, size_t count)
+{
+    return ts_to_tm_chunks(NULL, NULL, zones, ts, tm, count);
+}
+
+
+size_t tz64_gmtime_batch(const int64_t *restrict ts, struct tm *restrict tm, size_t count)
+{
+    int64_t local[BATCH_CHUNK];
+    struct chunk_fields f;
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+        size_t m = 0;
+        while (m < n && min_tm_ts <= ts[base + m] && ts[base + m] <= max_tm_ts) {
+            local[m] = ts[base + m];
+            m++;
+        }
+        decompose_chunk(local, m, &f);
+
+        for (size_t j = 0; j < m; j++) {
+            if (f.year[j] - base_year < INT32_MIN || f.year[j] - base_year > INT32_MAX) {
+                errno = EOVERFLOW;
+                return base + j;
+            }
+
+            struct tm *out = &tm[base + j];
+            out->tm_sec = f.sec[j];
+            out->tm_min = f.min[j];
+            out->tm_hour = f.hour[j];
+            out->tm_mday = f.mday[j];
+            out->tm_mon = f.mon[j] - 1;
+            out->tm_year = f.year[j] - base_year;
+            out->tm_wday = f.wday[j];
+            out->tm_yday = f.yday[j];
+            fill_utc(out);
+        }
+
+        if (m < n) {
+            errno = EOVERFLOW;
+            return base + m;
+        }
+    }
+
+    return count;
+}
+
+
+// Split a count of units since the epoch into seconds and the
+// fraction of a second left over, rounding towards the beginning of
+// time.  This is written without branches so that loops over it
+// vectorise.
+static inline int64_t split_units(int64_t units, int64_t per_sec, int32_t *frac)
+{
+    int64_t secs = units / per_sec;
+    int64_t rem = units - secs * per_sec;
+    const int64_t neg = rem < 0;
+    secs -= neg;
+    rem += neg * per_sec;
+
+    *frac = rem;
+    return secs;
+}
+
+
+// Convert count times in units of 1/per_sec seconds to broken-down
+// time, a chunk at a time.
+static size_t units_to_tm_batch(const struct tz64 *restrict tz, const int64_t *restrict units,
+                                int64_t per_sec, struct tm *restrict tm, int32_t *restrict frac,
+                                size_t count)
+{
+    int64_t ts[BATCH_CHUNK];
+    int32_t rem[BATCH_CHUNK];
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+        for (size_t j = 0; j < n; j++) {
+            ts[j] = split_units(units[base + j], per_sec, &rem[j]);
+        }
+
+        const size_t m = ts_to_tm_chunks(tz, NULL, NULL, ts, tm + base, n);
+        if (frac != NULL) {
+            memcpy(frac + base, rem, m * sizeof(rem[0]));
+        }
+
+        if (m < n) {
+            return base + m;
+        }
+    }
+
+    return count;
+}
+
+
+struct tm *tz64_ns_to_tm(const struct tz64 *restrict tz, int64_t ns, struct tm *restrict tm,
+                         int32_t *restrict nsec)
+{
+    return tz64_ts_to_tm(tz, split_units(ns, nsecs_per_sec, nsec), tm);
+}
+
+
+struct tm *tz64_us_to_tm(const struct tz64 *restrict tz, int64_t us, struct tm *restrict tm,
+                         int32_t *restrict usec)
+{
+    return tz64_ts_to_tm(tz, split_units(us, usecs_per_sec, usec), tm);
+}
+
+
+size_t tz64_ns_to_tm_batch(const struct tz64 *restrict tz, const int64_t *restrict ns,
+                           struct tm *restrict tm, int32_t *restrict nsec, size_t count)
+{
+    return units_to_tm_batch(tz, ns, nsecs_per_sec, tm, nsec, count);
+}
+
+
+size_t tz64_us_to_tm_batch(const struct tz64 *restrict tz, const int64_t *restrict us,
+                           struct tm *restrict tm, int32_t *restrict usec, size_t count)
+{
+    return units_to_tm_batch(tz, us, usecs_per_sec, tm, usec, count);
+}
+
+
+size_t tz64_ts_to_fields_batch(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                               struct tz64_fields *restrict fields, size_t count, unsigned int mask)
+{
+    if (!tz_ready(tz)) {
+        return 0;
+    }
+
+    const struct tz_offset *offset[BATCH_CHUNK];
+    int64_t local[BATCH_CHUNK];
+    int32_t extra[BATCH_CHUNK];
+    struct chunk_fields f;
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+        const size_t m = lookup_fwd(tz, ts + base, n, offset, local, extra);
+        decompose_chunk(local, m, &f);
+
+        for (size_t j = 0; j < m; j++) {
+            struct tz64_fields *out = &fields[base + j];
+            if (mask & (TZ64_FIELD_DATE | TZ64_FIELD_YDAY)) {
+                if (f.year[j] < INT32_MIN || f.year[j] > INT32_MAX) {
+                    errno = EOVERFLOW;
+                    return base + j;
+                }
+
+                out->yday = f.yday[j];
+            }
+
+            if (mask & TZ64_FIELD_DATE) {
+                out->year = f.year[j];
+                out->mon = f.mon[j];
+                out->mday = f.mday[j];
+            }
+
+            if (mask & TZ64_FIELD_TIME) {
+                out->hour = f.hour[j];
+                out->min = f.min[j];
+                out->sec = f.sec[j] + extra[j];
+            }
+
+            if (mask & TZ64_FIELD_WDAY) {
+                out->wday = f.wday[j];
+            }
+
+            if (mask & TZ64_FIELD_OFFSET) {
+                out->offset = offset[j] - tz->offsets;
+            }
+        }
+
+        if (m < n) {
+            return base + m;
+        }
+    }
+
+    return count;
+}
+
+
+const struct tz64_offset_info *tz64_fields_offset(const struct tz64 *restrict tz,
+                                                  const struct tz64_fields *restrict fields,
+                                                  struct tz64_offset_info *restrict info)
+{
+    if (!tz_ready(tz)) {
+        return NULL;
+    }
+
+    fill_offset_info(tz, &tz->offsets[fields->offset], info);
+    return info;
+}
+
+
+size_t tz64_offset_at_batch(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                            struct tz64_offset_info *restrict info, size_t count)
+{
+    if (!tz_ready(tz)) {
+        return 0;
+    }
+
+    const struct tz_offset *offset[BATCH_CHUNK];
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+        const size_t m = lookup_fwd(tz, ts + base, n, offset, NULL, NULL);
+        for (size_t j = 0; j < m; j++) {
+            fill_offset_info(tz, offset[j], &info[base + j]);
+        }
+
+        if (m < n) {
+            return base + m;
+        }
+    }
+
+    return count;
+}
+
+
+size_t tz64_ts_to_local_batch(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                              int64_t *restrict local, size_t count)
+{
+    if (!tz_ready(tz)) {
+        return 0;
+    }
+
+    const struct tz_offset *offset[BATCH_CHUNK];
+    int32_t extra[BATCH_CHUNK];
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+        const size_t m = lookup_fwd(tz, ts + base, n, offset, local + base, extra);
+        if (m < n) {
+            return base + m;
+        }
+    }
+
+    return count;
+}
+
+
+size_t tz64_ts_to_columns(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                          const struct tz64_columns *restrict cols, size_t count)
+{
+    if (!tz_ready(tz)) {
+        return 0;
+    }
+
+    const struct tz_offset *offset[BATCH_CHUNK];
+    int64_t local[BATCH_CHUNK];
+    int32_t extra[BATCH_CHUNK];
+    struct chunk_fields f;
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+        size_t m = lookup_fwd(tz, ts + base, n, offset, local, extra);
+        decompose_chunk(local, m, &f);
+
+        // Stop short of any year that doesn't fit in its column.
+        for (size_t j = 0; j < m; j++) {
+            if (f.year[j] < INT32_MIN || f.year[j] > INT32_MAX) {
+                errno = EOVERFLOW;
+                m = j;
+                break;
+            }
+        }
+
+        // Copy out the requested columns one at a time.
+        if (cols->year != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->year[base + j] = f.year[j];
+            }
+        }
+
+        if (cols->mon != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->mon[base + j] = f.mon[j];
+            }
+        }
+
+        if (cols->mday != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->mday[base + j] = f.mday[j];
+            }
+        }
+
+        if (cols->hour != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->hour[base + j] = f.hour[j];
+            }
+        }
+
+        if (cols->min != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->min[base + j] = f.min[j];
+            }
+        }
+
+        if (cols->sec != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->sec[base + j] = f.sec[j] + extra[j];
+            }
+        }
+
+        if (cols->yday != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->yday[base + j] = f.yday[j];
+            }
+        }
+
+        if (cols->wday != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->wday[base + j] = f.wday[j];
+            }
+        }
+
+        if (cols->utoff != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->utoff[base + j] = offset[j]->utoff;
+            }
+        }
+
+        if (cols->isdst != NULL) {
+            for (size_t j = 0; j < m; j++) {
+                cols->isdst[base + j] = offset[j]->isdst;
+            }
+        }
+
+        if (m < n) {
+            return base + m;
+        }
+    }
+
+    return count;
+}
+
+
+static void clamp(int *value, int64_t *overflow, int max)
+{
+    *overflow += *value;
+    *value = *overflow % max;
+    *overflow /= max;
+    if (*value < 0) {
+        *value += max;
+        *overflow -= 1;
+    }
+}
+
+
+static int64_t canonicalize_tm(struct tm *tm)
+{
+    // Convert to the time to canonical form.
+    int64_t overflow = 0;
+    clamp(&tm->tm_sec, &overflow, secs_per_min);
+    clamp(&tm->tm_min, &overflow, mins_per_hour);
+    clamp(&tm->tm_hour, &overflow, hours_per_day);
+
+    // Convert the year, month and day to days since the beginning of
+    // 1 AD.
+    int64_t days = daynum(tm->tm_year + base_year, tm->tm_mon + 1, tm->tm_mday) + overflow;
+    days -= 1;
+
+    // Convert days into 400 year blocks and extra.
+    int64_t year = 1 + 400 * (days / days_per_400_years);
+    days %= days_per_400_years;
+    if (days < 0) {
+        days += days_per_400_years;
+        year -= 400;
+    }
+
+    year += populate_ymd(tm, days);
+    tm->tm_year = year - base_year;
+
+    return year;
+}
+
+
+// Return non-zero if the fields of tm are all within their usual
+// ranges, so that canonicalize_tm would leave them alone.
+static inline int is_canonical(const struct tm *tm, int leap)
+{
+    return (unsigned)tm->tm_sec < secs_per_min &&
+        (unsigned)tm->tm_min < mins_per_hour &&
+        (unsigned)tm->tm_hour < hours_per_day &&
+        (unsigned)tm->tm_mon < 12 &&
+        tm->tm_mday >= 1 &&
+        tm->tm_mday <= month_starts[leap][tm->tm_mon + 1] - month_starts[leap][tm->tm_mon];
+}
+
+
+// Return the day of the week of a timestamp as if it were UTC.
+static inline int utc_wday(int64_t ts)
+{
+    // 1970-01-01 was a Thursday.
+    int64_t days = ts / secs_per_day;
+    if (ts % secs_per_day < 0) {
+        days--;
+    }
+
+    int wday = (days + 4) % days_per_week;
+    return (wday < 0) ? wday + days_per_week : wday;
+}
+
+
+// Find the offsets that could apply to a local time, expressed as a
+// timestamp as if it were UTC.  Stores the latest offset whose range
+// contains the local time in *offset.  If the local time falls in a
+// gap or fold then also stores the offset on the other side of the
+// transition in *other and the time of the transition in *trans.
+static inline int find_local(const struct tz64 *restrict tz, struct tz64_cursor *restrict cursor, int64_t ts,
+                             const struct tz_offset **restrict offset, const struct tz_offset **restrict other,
+                             int64_t *restrict trans)
+{
+    // Find the latest offset that contains the timestamp.
+    const struct tz_offset *curr_offset, *prev_offset, *next_offset;
+    int64_t curr_ts, next_ts;
+    int64_t curr_trans, next_trans;
+    if (ts - tz->offsets[tz->offset_map[tz->ts_count - 1]].utoff < tz->timestamps[tz->ts_count - 1]) {
+        uint32_t k;
+        if (cursor == NULL) {
+            k = find_local_edge(tz, ts);
+        } else {
+            k = step_local_edge(tz, cursor->rev_index, ts);
+            cursor->rev_index = k;
+        }
+
+        // Most local times fall clear of any gap or fold, and need no
+        // further thought.
+        uint32_t i = k / 2;
+        if ((k & 1) != 0 || i == 0) {
+            *offset = &tz->offsets[tz->offset_map[i]];
+            return TZ64_LOCAL_NORMAL;
+        }
+
+        // Otherwise the local time falls in transition i's gap or
+        // fold.  The offset before a gap lasts until its end.
+        if (tz->offsets[tz->offset_map[i]].utoff > tz->offsets[tz->offset_map[i - 1]].utoff) {
+            i--;
+        }
+
+        curr_offset = &tz->offsets[tz->offset_map[i]];
+        curr_ts = ts;
+        curr_trans = tz->timestamps[i];
+        prev_offset = (i == 0) ? NULL : &tz->offsets[tz->offset_map[i - 1]];
+
+        if (i + 1 < tz->ts_count) {
+            next_offset = &tz->offsets[tz->offset_map[i + 1]];
+            next_ts = ts;
+            next_trans = tz->timestamps[i + 1];
+        } else if (tz->extra_ts == NULL) {
+            next_offset = NULL;
+            next_ts = 0;
+            next_trans = 0;
+        } else {
+            int64_t adj_ts = calc_adj_ts(ts);
+            next_ts = adj_ts;
+            int j = find_extra_rev_index(tz, adj_ts);
+            next_offset = &tz->offsets[tz->offset_map[(j & 1) - 2]];
+            next_trans = extra_trans(tz, j);
+        }
+    } else if (tz->extra_ts == NULL) {
+        uint32_t i = tz->ts_count - 1;
+        curr_offset = &tz->offsets[tz->offset_map[i]];
+        curr_ts = ts;
+        curr_trans = tz->timestamps[i];
+        prev_offset = (i == 0) ? NULL : &tz->offsets[tz->offset_map[i - 1]];
+
+        next_ts = 0;
+        next_offset = NULL;
+        next_trans = 0;
+    } else {
+        int64_t adj_ts = calc_adj_ts(ts);
+        int i = find_extra_rev_index(tz, adj_ts);
+        curr_offset = &tz->offsets[tz->offset_map[(i & 1) - 2]];
+        curr_ts = adj_ts;
+        curr_trans = extra_trans(tz, i);
+
+        next_offset = &tz->offsets[tz->offset_map[((i + 1) & 1) - 2]];
+        next_ts = adj_ts;
+        next_trans = extra_trans(tz, i + 1);
+
+        // Decide if the previous transition is explicit.
+        int64_t diff = curr_trans - extra_trans(tz, i - 1);
+        if (tz->ts_count >= 2 && ts - diff < tz->timestamps[tz->ts_count - 1]) {
+            prev_offset = &tz->offsets[tz->offset_map[tz->ts_count - 2]];
+        } else {
+            prev_offset = &tz->offsets[tz->offset_map[((i + 1) & 1) - 2]];
+        }
+    }
+
+    // The local time is both after this offset's range and before the
+    // next one: it's in a gap.
+    if (next_offset != NULL && next_ts - curr_offset->utoff >= next_trans) {
+        *offset = curr_offset;
+        *other = next_offset;
+        *trans = next_trans + (ts - next_ts);
+        return TZ64_LOCAL_NONEXISTENT;
+    }
+
+    // The local time could belong in either this offset or the
+    // previous one: it's in a fold.
+    if (prev_offset != NULL && curr_ts - prev_offset->utoff < curr_trans) {
+        *offset = curr_offset;
+        *other = prev_offset;
+        *trans = curr_trans + (ts - curr_ts);
+        return TZ64_LOCAL_AMBIGUOUS;
+    }
+
+    *offset = curr_offset;
+    return TZ64_LOCAL_NORMAL;
+}
+
+
+// How the broken-down time given to resolve_local should be fixed up.
+enum renorm {
+    renorm_none,
+    renorm_shift,
+    renorm_recalc
+};
+
+
+// Convert a local time, expressed as a timestamp as if it were UTC,
+// to a real timestamp.  The DST indicator and offset from UTC are the
+// hints from a struct tm used to settle ambiguous and non-existent
+// times.  Stores the chosen offset in *offset_out and how the
+// broken-down time should be adjusted in *renorm.
+static inline int64_t resolve_local(const struct tz64 *restrict tz, struct tz64_cursor *restrict cursor,
+                                    int64_t ts, int isdst, long gmtoff,
+                                    const struct tz_offset **restrict offset_out, enum renorm *restrict renorm)
+{
+    *renorm = renorm_none;
+
+    const struct tz_offset *offset, *other;
+    int64_t trans;
+    switch (find_local(tz, cursor, ts, &offset, &other, &trans)) {
+    case TZ64_LOCAL_NONEXISTENT:
+        // It's not a real time.  If the DST indicator matches this
+        // offset then we assume that something was added to a valid
+        // struct tm to push it into the next; otherwise we'll assume
+        // subtraction from the next.
+        if (isdst >= 0 && !isdst == !offset->isdst && !isdst != !other->isdst) {
+            // Adjust the timestamp by the current offset.
+            ts -= offset->utoff;
+
+            // The broken-down time needs recomputing using the next
+            // offset.
+            *renorm = renorm_shift;
+            offset = other;
+        } else {
+            // Adjust the timestamp by the next offset.
+            ts -= other->utoff;
+
+            // The broken-down time needs recomputing using the current
+            // offset.
+            *renorm = renorm_recalc;
+        }
+        break;
+
+    case TZ64_LOCAL_AMBIGUOUS:
+        // Consult the dst indicator and, failing that, the offset from
+        // UTC.
+        if (isdst >= 0 && !isdst == !other->isdst &&
+            (!isdst != !offset->isdst || gmtoff == other->utoff)) {
+            offset = other;
+        }
+        ts -= offset->utoff;
+        break;
+
+    default:
+        ts -= offset->utoff;
+        break;
+    }
+
+    *offset_out = offset;
+    return ts;
+}
+
+
+// Convert broken-down time to a timestamp.  If cursor is not NULL
+// then use it to look up the leap seconds and offset.
+static inline int64_t tm_to_ts(const struct tz64 *tz, struct tz64_cursor *cursor, struct tm *tm)
+{
+    // Sequester the seconds when dealing with time zones that support
+    // leap seconds.
+    int sec = tm->tm_sec;
+    if (tz->leap_count != 0) {
+        tm->tm_sec = 0;
+    }
+
+    // Try to convert tm to canonical form.  If the tm overflows then
+    // return -1.  Most times are already canonical, and for those we
+    // need only fill in the days of the year and week.
+    int64_t ts;
+    const int64_t year = (int64_t)tm->tm_year + base_year;
+    const int leap = is_leap(year);
+    if (is_canonical(tm, leap)) {
+        ts = tm_utc_to_ts(tm);
+        tm->tm_yday = month_starts[leap][tm->tm_mon] + tm->tm_mday - 1;
+        tm->tm_wday = utc_wday(ts);
+    } else {
+        if (canonicalize_tm(tm) - base_year != tm->tm_year) {
+            tm->tm_sec = sec;
+            errno = EOVERFLOW;
+            return -1;
+        }
+
+        // Convert that to a timestamp as if it were UTC.
+        ts = tm_utc_to_ts(tm);
+    }
+
+    // Restore the seconds if necessary.
+    int recalc = 0;
+    int64_t leap_ts = 0;
+    int32_t lsec = 0;
+    if (tz->leap_count != 0) {
+        tm->tm_sec = sec;
+        ts += sec;
+        recalc = (sec < 0 || sec > 59) ? 1 : 0;
+
+        // Adjust for leap seconds.
+        uint32_t li;
+        if (cursor == NULL) {
+            li = find_rev_leap(tz, encode_ymdhm(tm));
+        } else {
+            li = step_fwd_index(tz->rev_leap_ts, &tz->rev_leap_eytz, tz->leap_count, cursor->rev_leap_index, encode_ymdhm(tm));
+            cursor->rev_leap_index = li;
+        }
+        lsec = tz->leap_secs[li];
+        ts += lsec;
+        leap_ts = (li + 1 < tz->leap_count) ? tz->leap_ts[li + 1] : INT64_MAX;
+    }
+
+    const struct tz_offset *offset;
+    enum renorm renorm;
+    ts = resolve_local(tz, cursor, ts, tm->tm_isdst, tm->tm_gmtoff, &offset, &renorm);
+    if (renorm == renorm_shift) {
+        ts_to_tm_utc(tm, ts + offset->utoff);
+    } else if (renorm == renorm_recalc) {
+        recalc = 1;
+    }
+
+    if (recalc) {
+        int extra = (leap_ts != 0 && tm->tm_sec == 60 && leap_ts - 60 <= ts && ts <= leap_ts) ? 1 : 0;
+        ts_to_tm_utc(tm, ts + offset->utoff - lsec - extra);
+        tm->tm_sec += extra;
+    }
+
+    // We've chosen our offset.  Use it to fill in the remaining
+    // parts of broken-down time.
+    tm->tm_isdst = offset->isdst;
+    tm->tm_gmtoff = offset->utoff;
+    tm->tm_zone = tz->desig + offset->desig;
+    return ts;
+}
+
+
+int64_t tz64_tm_to_ts(const struct tz64 *tz, struct tm *tm)
+{
+    if (!tz_ready(tz)) {
+        return -1;
+    }
+
+    return tm_to_ts(tz, NULL, tm);
+}
+
+
+int64_t tz64_cursor_tm_to_ts(struct tz64_cursor *cursor, struct tm *tm)
+{
+    if (!tz_ready(cursor->tz)) {
+        return -1;
+    }
+
+    return tm_to_ts(cursor->tz, cursor, tm);
+}
+
+
+int64_t tz64_timegm(struct tm *tm)
+{
+    // As tm_to_ts, but with no offset to look up.
+    int64_t ts;
+    const int64_t year = (int64_t)tm->tm_year + base_year;
+    const int leap = is_leap(year);
+    if (is_canonical(tm, leap)) {
+        ts = tm_utc_to_ts(tm);
+        tm->tm_yday = month_starts[leap][tm->tm_mon] + tm->tm_mday - 1;
+        tm->tm_wday = utc_wday(ts);
+    } else {
+        if (canonicalize_tm(tm) - base_year != tm->tm_year) {
+            errno = EOVERFLOW;
+            return -1;
+        }
+
+        ts = tm_utc_to_ts(tm);
+    }
+
+    fill_utc(tm);
+    return ts;
+}
+
+
+// Copy compact broken-down time into a struct tm as
+// tz64_fields_to_ts reads it, with the offset, if any, as the hints
+// for ambiguous times.  Returns -1 and sets errno if the year doesn't
+// fit.
+static int fields_to_tm(const struct tz64 *restrict tz, const struct tz64_fields *restrict fields,
+                        unsigned int mask, struct tm *restrict tm)
+{
+    memset(tm, 0, sizeof(*tm));
+    if (__builtin_sub_overflow(fields->year, base_year, &tm->tm_year)) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    tm->tm_mon = fields->mon - 1;
+    tm->tm_mday = fields->mday;
+    if ((mask & TZ64_FIELD_TIME) != 0) {
+        tm->tm_hour = fields->hour;
+        tm->tm_min = fields->min;
+        tm->tm_sec = fields->sec;
+    }
+
+    tm->tm_isdst = -1;
+    if ((mask & TZ64_FIELD_OFFSET) != 0) {
+        tm->tm_isdst = tz->offsets[fields->offset].isdst;
+        tm->tm_gmtoff = tz->offsets[fields->offset].utoff;
+    }
+
+    return 0;
+}
+
+
+int64_t tz64_fields_to_ts(const struct tz64 *restrict tz, const struct tz64_fields *restrict fields,
+                          unsigned int mask)
+{
+    if (!tz_ready(tz)) {
+        return -1;
+    }
+
+    struct tm tm;
+    if (fields_to_tm(tz, fields, mask, &tm) != 0) {
+        return -1;
+    }
+
+    // Canonical times in zones without leap seconds can go straight
+    // to the offset search.  Anything else takes the long way round
+    // on a copy.
+    if (tz->leap_count != 0 || !is_canonical(&tm, is_leap(fields->year))) {
+        return tm_to_ts(tz, NULL, &tm);
+    }
+
+    const struct tz_offset *offset;
+    enum renorm renorm;
+    return resolve_local(tz, NULL, tm_utc_to_ts(&tm), tm.tm_isdst, tm.tm_gmtoff, &offset, &renorm);
+}
+
+
+struct tz64_fields *tz64_convert(const struct tz64 *restrict tz_from, const struct tz64 *restrict tz_to,
+                                 const struct tz64_fields *restrict in, struct tz64_fields *restrict out,
+                                 unsigned int mask)
+{
+    if (!tz_ready(tz_from) || !tz_ready(tz_to)) {
+        return NULL;
+    }
+
+    struct tm tm;
+    if (fields_to_tm(tz_from, in, mask, &tm) != 0) {
+        return NULL;
+    }
+
+    // Leap seconds and out-of-range fields need the full conversion
+    // in both directions.
+    const int fast = tz_from->leap_count == 0 && tz_to->leap_count == 0 && is_canonical(&tm, is_leap(in->year));
+    const int64_t local = tm_utc_to_ts(&tm);
+    int64_t ts;
+    if (fast) {
+        const struct tz_offset *offset;
+        enum renorm renorm;
+        ts = resolve_local(tz_from, NULL, local, tm.tm_isdst, tm.tm_gmtoff, &offset, &renorm);
+    } else {
+        // Distinguish failure from a legitimate -1.
+        const int saved_errno = errno;
+        errno = 0;
+        ts = tm_to_ts(tz_from, NULL, &tm);
+        if (ts == -1 && errno != 0) {
+            return NULL;
+        }
+        errno = saved_errno;
+    }
+
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    int32_t lsec, extra;
+    const struct tz_offset *offset = fwd_offset(tz_to, ts, &lsec, &extra);
+    const int64_t shifted = ts + offset->utoff - lsec - extra;
+
+    // If the time stays on the same day then the date carries over
+    // and only the time of day needs working out.
+    const int64_t secs = tm.tm_hour * secs_per_hour + tm.tm_min * secs_per_min + tm.tm_sec + shifted - local;
+    if (!fast || secs < 0 || secs >= secs_per_day) {
+        return fill_fields(tz_to, shifted, offset, extra, out, mask);
+    }
+
+    if (mask & TZ64_FIELD_DATE) {
+        out->year = in->year;
+        out->mon = in->mon;
+        out->mday = in->mday;
+    }
+
+    if (mask & TZ64_FIELD_TIME) {
+        out->hour = secs / secs_per_hour;
+        out->min = secs / secs_per_min % mins_per_hour;
+        out->sec = secs % secs_per_min;
+    }
+
+    if (mask & TZ64_FIELD_WDAY) {
+        out->wday = utc_wday(shifted);
+    }
+
+    if (mask & (TZ64_FIELD_DATE | TZ64_FIELD_YDAY)) {
+        out->yday = month_starts[is_leap(in->year)][tm.tm_mon] + tm.tm_mday - 1;
+    }
+
+    if (mask & TZ64_FIELD_OFFSET) {
+        out->offset = offset - tz_to->offsets;
+    }
+
+    return out;
+}
+
+
+size_t tz64_convert_batch(const struct tz64 *restrict tz_from, const struct tz64 *restrict tz_to,
+                          const struct tz64_fields *restrict in, struct tz64_fields *restrict out,
+                          size_t count, unsigned int mask)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (tz64_convert(tz_from, tz_to, &in[i], &out[i], mask) == NULL) {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+
+// Move canonical broken-down time by delta seconds, which must be no
+// more than a day either way, carrying into the minute, hour and day
+// only when needed.  Returns -1 if the year would overflow.
+static int step_tm(struct tm *tm, int64_t delta)
+{
+    // Most steps stay within the minute.
+    const int64_t sec = tm->tm_sec + delta;
+    if (0 <= sec && sec < secs_per_min) {
+        tm->tm_sec = sec;
+        return 0;
+    }
+
+    int64_t secs = tm->tm_hour * secs_per_hour + tm->tm_min * secs_per_min + sec;
+    int days = 0;
+    if (secs < 0) {
+        secs += secs_per_day;
+        days = -1;
+    } else if (secs >= secs_per_day) {
+        secs -= secs_per_day;
+        days = 1;
+    }
+
+    if (days > 0) {
+        const int leap = is_leap((int64_t)tm->tm_year + base_year);
+        if (tm->tm_mday < month_starts[leap][tm->tm_mon + 1] - month_starts[leap][tm->tm_mon]) {
+            tm->tm_mday++;
+            tm->tm_yday++;
+        } else if (tm->tm_mon < 11) {
+            tm->tm_mon++;
+            tm->tm_mday = 1;
+            tm->tm_yday++;
+        } else if (tm->tm_year < INT32_MAX) {
+            tm->tm_year++;
+            tm->tm_mon = 0;
+            tm->tm_mday = 1;
+            tm->tm_yday = 0;
+        } else {
+            return -1;
+        }
+    } else if (days < 0) {
+        if (tm->tm_mday > 1) {
+            tm->tm_mday--;
+            tm->tm_yday--;
+        } else if (tm->tm_mon > 0) {
+            const int leap = is_leap((int64_t)tm->tm_year + base_year);
+            tm->tm_mon--;
+            tm->tm_mday = month_starts[leap][tm->tm_mon + 1] - month_starts[leap][tm->tm_mon];
+            tm->tm_yday--;
+        } else if (tm->tm_year > INT32_MIN) {
+            tm->tm_year--;
+            const int leap = is_leap((int64_t)tm->tm_year + base_year);
+            tm->tm_mon = 11;
+            tm->tm_mday = 31;
+            tm->tm_yday = month_starts[leap][12] - 1;
+        } else {
+            return -1;
+        }
+    }
+
+    tm->tm_wday = (tm->tm_wday + days + days_per_week) % days_per_week;
+    tm->tm_hour = secs / secs_per_hour;
+    tm->tm_min = secs / secs_per_min % mins_per_hour;
+    tm->tm_sec = secs % secs_per_min;
+    return 0;
+}
+
+
+// Decide whether tm already shows offset, and isn't a leap second, so
+// that it can be stepped to a time with that offset rather than
+// converted afresh.  extra is 1 if the new time is a leap second.
+static inline int can_step(const struct tz64 *restrict tz, const struct tm *tm,
+                           const struct tz_offset *offset, int32_t extra)
+{
+    return extra == 0 && tm->tm_sec < secs_per_min &&
+        tm->tm_gmtoff == offset->utoff &&
+        !tm->tm_isdst == !offset->isdst &&
+        tm->tm_zone == tz->desig + offset->desig;
+}
+
+
+struct tm *tz64_tm_advance(const struct tz64 *restrict tz, struct tm *restrict tm, int64_t ts_old, int64_t ts_new)
+{
+    if (!tz_ready(tz)) {
+        return NULL;
+    }
+
+    if (ts_new < min_tm_ts || ts_new > max_tm_ts) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    // Step the fields if the offset and leap seconds in effect at
+    // ts_new are the ones tm already shows.
+    int32_t lsec, extra;
+    const struct tz_offset *offset = fwd_offset(tz, ts_new, &lsec, &extra);
+    int64_t delta;
+    if (!__builtin_sub_overflow(ts_new, ts_old, &delta) &&
+        -secs_per_day <= delta && delta <= secs_per_day &&
+        can_step(tz, tm, offset, extra)) {
+        int32_t old_lsec = 0, old_extra = 0;
+        if (tz->leap_count != 0) {
+            old_lsec = fwd_leap_secs(tz, ts_old, &old_extra);
+        }
+
+        if (old_lsec == lsec && old_extra == 0 && step_tm(tm, delta) == 0) {
+            return tm;
+        }
+    }
+
+    return fill_tm(tz, ts_new + offset->utoff - lsec - extra, offset, extra, tm);
+}
+
+
+int64_t tz64_tm_advance_local(const struct tz64 *restrict tz, struct tm *restrict tm, int64_t ts, int64_t delta)
+{
+    if (!tz_ready(tz)) {
+        return -1;
+    }
+
+    // If the offset in effect delta seconds later is the one tm
+    // already shows then the wall clock moves in step with the
+    // timestamp.  Time zones with leap seconds always go the long way.
+    int64_t ts_new;
+    if (tz->leap_count == 0 && -secs_per_day <= delta && delta <= secs_per_day &&
+        !__builtin_add_overflow(ts, delta, &ts_new) && min_tm_ts <= ts_new && ts_new <= max_tm_ts) {
+        int32_t lsec, extra;
+        const struct tz_offset *offset = fwd_offset(tz, ts_new, &lsec, &extra);
+        if (can_step(tz, tm, offset, extra) && step_tm(tm, delta) == 0) {
+            return ts_new;
+        }
+    }
+
+    // Otherwise add delta to the seconds and convert.
+    if (delta < INT32_MIN || delta > INT32_MAX || __builtin_add_overflow(tm->tm_sec, (int)delta, &tm->tm_sec)) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    return tm_to_ts(tz, NULL, tm);
+}
+
+
+size_t tz64_ts_to_tm_zones(const struct tz64 *const *zones, size_t count, int64_t ts, struct tm *restrict tm)
+{
+    if (ts < min_tm_ts || ts > max_tm_ts) {
+        errno = EOVERFLOW;
+        return 0;
+    }
+
+    // Break the timestamp down in UTC once.  If its year doesn't fit
+    // then the zones' years may still, so convert each in full.
+    struct tm utc;
+    const int64_t year = ts_to_tm_utc(&utc, ts);
+    const int whole = year - base_year < INT32_MIN || year - base_year > INT32_MAX;
+
+    // Each zone is then a step of less than a day from UTC.
+    for (size_t i = 0; i < count; i++) {
+        const struct tz64 *tz = zones[i];
+        if (!tz_ready(tz)) {
+            return i;
+        }
+
+        int32_t lsec, extra;
+        const struct tz_offset *offset = fwd_offset(tz, ts, &lsec, &extra);
+        const int64_t delta = offset->utoff - lsec - extra;
+
+        tm[i] = utc;
+        if (whole || delta < -secs_per_day || delta > secs_per_day || step_tm(&tm[i], delta) != 0) {
+            if (fill_tm(tz, ts + delta, offset, extra, &tm[i]) == NULL) {
+                return i;
+            }
+            continue;
+        }
+
+        tm[i].tm_sec += extra;
+        tm[i].tm_isdst = offset->isdst;
+        tm[i].tm_gmtoff = offset->utoff;
+        tm[i].tm_zone = tz->desig + offset->desig;
+    }
+
+    return count;
+}
+
+
+const struct tz64_resolution *tz64_resolve_local(const struct tz64 *restrict tz,
+                                                 const struct tz64_fields *restrict fields, int policy,
+                                                 struct tz64_resolution *restrict out)
+{
+    if (!tz_ready(tz)) {
+        return NULL;
+    }
+
+    // Convert the fields to a local time as if it were UTC, holding
+    // back the seconds in time zones with leap seconds as tm_to_ts
+    // does.
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (__builtin_sub_overflow(fields->year, base_year, &tm.tm_year)) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    tm.tm_mon = fields->mon - 1;
+    tm.tm_mday = fields->mday;
+    tm.tm_hour = fields->hour;
+    tm.tm_min = fields->min;
+    tm.tm_sec = (tz->leap_count != 0) ? 0 : fields->sec;
+    if (!is_canonical(&tm, is_leap(fields->year)) && canonicalize_tm(&tm) - base_year != tm.tm_year) {
+        errno = EOVERFLOW;
+        return NULL;
+    }
+
+    int64_t ts = tm_utc_to_ts(&tm);
+    if (tz->leap_count != 0) {
+        ts += fields->sec + tz->leap_secs[find_rev_leap(tz, encode_ymdhm(&tm))];
+    }
+
+    // Work out both candidates in one go.  In a gap or fold the other
+    // offset is always the larger, so it gives the earlier timestamp.
+    const struct tz_offset *offset, *other;
+    int64_t trans;
+    out->kind = find_local(tz, NULL, ts, &offset, &other, &trans);
+    out->latest = ts - offset->utoff;
+    out->earliest = (out->kind == TZ64_LOCAL_NORMAL) ? out->latest : ts - other->utoff;
+
+    switch (policy) {
+    case TZ64_RESOLVE_EARLIEST:
+        out->ts = out->earliest;
+        break;
+
+    case TZ64_RESOLVE_LATEST:
+        out->ts = out->latest;
+        break;
+
+    case TZ64_RESOLVE_REJECT:
+        out->ts = out->latest;
+        if (out->kind != TZ64_LOCAL_NORMAL) {
+            errno = EINVAL;
+            return NULL;
+        }
+        break;
+
+    case TZ64_RESOLVE_SHIFT_FORWARD:
+        out->ts = (out->kind == TZ64_LOCAL_NONEXISTENT) ? trans : out->earliest;
+        break;
+
+    default:
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return out;
+}
+
+
+// Local times for a chunk of rows, one array per field, in the form
+// compose_kernel wants.  Years are in full and months count from 1.
+struct chunk_local {
+    uint32_t year[BATCH_CHUNK];
+    uint32_t mon[BATCH_CHUNK];
+    uint32_t mday[BATCH_CHUNK];
+    uint32_t secs[BATCH_CHUNK];
+};
+
+
+// Rows with years from 1 up to compose_limit, and with every other
+// field in its usual range, are composed by compose_kernel.  That
+// keeps the day arithmetic non-negative and within 32 bits.
+static const int32_t compose_limit = 1000000;
+
+
+// Compose a full chunk of local times into timestamps as if they were
+// UTC, producing the same results as tm_utc_to_ts for rows within the
+// kernel's range.  This is daynum without the branches: years of 1 or
+// more never need its compensation for negative numbers.
+MULTIVERSIONED
+static void compose_kernel(const struct chunk_local *restrict c, int64_t *restrict local)
+{
+    const int64_t epoch = daynum(ref_year, 1, 1);
+
+    for (int j = 0; j < BATCH_CHUNK; j++) {
+        const uint32_t late = c->mon[j] > 2;
+        const uint32_t y = c->year[j] - (late ^ 1);
+        const uint32_t m = c->mon[j] + (late ? 1 : 13);
+        const uint32_t days = y * 1461 / 4 - y / 100 + y / 400 + m * 153 / 5 + c->mday[j] - 428;
+        local[j] = ((int64_t)days - epoch) * secs_per_day + c->secs[j];
+    }
+}
+
+
+// Convert row i of cols to a timestamp the slow way.  Returns -1 and
+// sets errno to a non-zero value on failure.
+static int64_t column_to_ts(const struct tz64 *restrict tz, struct tz64_cursor *restrict cursor,
+                            const struct tz64_columns *restrict cols, size_t i)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (__builtin_sub_overflow(cols->year[i], base_year, &tm.tm_year)) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    tm.tm_mon = cols->mon[i] - 1;
+    tm.tm_mday = cols->mday[i];
+    tm.tm_hour = (cols->hour != NULL) ? cols->hour[i] : 0;
+    tm.tm_min = (cols->min != NULL) ? cols->min[i] : 0;
+    tm.tm_sec = (cols->sec != NULL) ? cols->sec[i] : 0;
+    tm.tm_isdst = (cols->isdst != NULL) ? cols->isdst[i] : -1;
+    tm.tm_gmtoff = (cols->utoff != NULL) ? cols->utoff[i] : 0;
+
+    errno = 0;
+    return tm_to_ts(tz, cursor, &tm);
+}
+
+
+size_t tz64_columns_to_ts(const struct tz64 *restrict tz, const struct tz64_columns *restrict cols,
+                          int64_t *restrict ts, size_t count)
+{
+    if (!tz_ready(tz)) {
+        return 0;
+    }
+
+    struct tz64_cursor cursor;
+    tz64_cursor_init(&cursor, tz);
+
+    struct chunk_local c;
+    int64_t local[BATCH_CHUNK];
+    uint8_t slow[BATCH_CHUNK];
+    const int saved_errno = errno;
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+
+        // Gather the fields, noting the rows the kernel can't handle.
+        // Time zones with leap seconds always take the slow way.
+        for (size_t j = 0; j < n; j++) {
+            const size_t i = base + j;
+            const int32_t year = cols->year[i];
+            const int mon = cols->mon[i];
+            const int mday = cols->mday[i];
+            const int hour = (cols->hour != NULL) ? cols->hour[i] : 0;
+            const int min = (cols->min != NULL) ? cols->min[i] : 0;
+            const int sec = (cols->sec != NULL) ? cols->sec[i] : 0;
+
+            slow[j] = tz->leap_count != 0 ||
+                year < 1 || year >= compose_limit || mon < 1 || mon > 12 || mday < 1 || mday > 31 ||
+                hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 59;
+            c.year[j] = year;
+            c.mon[j] = mon;
+            c.mday[j] = mday;
+            c.secs[j] = hour * secs_per_hour + min * secs_per_min + sec;
+        }
+
+        // Pad out a partial chunk so the kernel can always run in full.
+        for (size_t j = n; j < BATCH_CHUNK; j++) {
+            c.year[j] = alt_ref_year;
+            c.mon[j] = 1;
+            c.mday[j] = 1;
+            c.secs[j] = 0;
+        }
+
+        compose_kernel(&c, local);
+
+        // Resolve each local time to a timestamp.  The cursor makes
+        // this cheap when consecutive rows share a transition.
+        for (size_t j = 0; j < n; j++) {
+            const size_t i = base + j;
+            if (slow[j]) {
+                const int64_t t = column_to_ts(tz, &cursor, cols, i);
+                if (t == -1 && errno != 0) {
+                    return i;
+                }
+                ts[i] = t;
+            } else {
+                const int isdst = (cols->isdst != NULL) ? cols->isdst[i] : -1;
+                const long gmtoff = (cols->utoff != NULL) ? cols->utoff[i] : 0;
+                const struct tz_offset *offset;
+                enum renorm renorm;
+                ts[i] = resolve_local(tz, &cursor, local[j], isdst, gmtoff, &offset, &renorm);
+            }
+        }
+    }
+
+    errno = saved_errno;
+    return count;
+}
+
+
+size_t tz64_timegm_batch(struct tm *restrict tm, int64_t *restrict ts, size_t count)
+{
+    struct chunk_local c;
+    int64_t local[BATCH_CHUNK];
+    uint8_t slow[BATCH_CHUNK];
+    const int saved_errno = errno;
+
+    for (size_t base = 0; base < count; base += BATCH_CHUNK) {
+        const size_t n = (count - base < BATCH_CHUNK) ? count - base : BATCH_CHUNK;
+
+        // Gather the fields, noting the rows the kernel can't handle.
+        // Those that aren't canonical need writing back in full, so
+        // they take the slow way too.
+        for (size_t j = 0; j < n; j++) {
+            const struct tm *in = &tm[base + j];
+            const int64_t year = (int64_t)in->tm_year + base_year;
+            slow[j] = year < 1 || year >= compose_limit || !is_canonical(in, is_leap(year));
+            c.year[j] = year;
+            c.mon[j] = in->tm_mon + 1;
+            c.mday[j] = in->tm_mday;
+            c.secs[j] = in->tm_hour * secs_per_hour + in->tm_min * secs_per_min + in->tm_sec;
+        }
+
+        // Pad out a partial chunk so the kernel can always run in full.
+        for (size_t j = n; j < BATCH_CHUNK; j++) {
+            c.year[j] = alt_ref_year;
+            c.mon[j] = 1;
+            c.mday[j] = 1;
+            c.secs[j] = 0;
+        }
+
+        compose_kernel(&c, local);
+
+        for (size_t j = 0; j < n; j++) {
+            const size_t i = base + j;
+            struct tm *out = &tm[i];
+            if (slow[j]) {
+                errno = 0;
+                const int64_t t = tz64_timegm(out);
+                if (t == -1 && errno != 0) {
+                    return i;
+                }
+                ts[i] = t;
+            } else {
+                ts[i] = local[j];
+                out->tm_yday = month_starts[is_leap(c.year[j])][out->tm_mon] + out->tm_mday - 1;
+                out->tm_wday = utc_wday(local[j]);
+                fill_utc(out);
+            }
+        }
+    }
+
+    errno = saved_errno;
+    return count;
+}
+
+
+// Convert broken-down time to units of 1/per_sec seconds, adding frac
+// units.
+static int64_t tm_to_units(const struct tz64 *restrict tz, struct tm *tm, int64_t per_sec, int32_t frac)
+{
+    if (!tz_ready(tz)) {
+        return -1;
+    }
+
+    // Distinguish failure from a legitimate -1.
+    const int saved_errno = errno;
+    errno = 0;
+    const int64_t ts = tm_to_ts(tz, NULL, tm);
+    if (ts == -1 && errno != 0) {
+        return -1;
+    }
+    errno = saved_errno;
+
+    int64_t units;
+    if (__builtin_mul_overflow(ts, per_sec, &units) ||
+        __builtin_add_overflow(units, frac, &units)) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    return units;
+}
+
+
+int64_t tz64_tm_to_ns(const struct tz64 *restrict tz, struct tm *tm, int32_t nsec)
+{
+    return tm_to_units(tz, tm, nsecs_per_sec, nsec);
+}
+
+
+int64_t tz64_tm_to_us(const struct tz64 *restrict tz, struct tm *tm, int32_t usec)
+{
+    return tm_to_units(tz, tm, usecs_per_sec, usec);
 }
 
 ////////////////////////////////////////////////////////////////////////
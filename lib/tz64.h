@@ -23,12 +23,347 @@
 #define TZ64_H
 
 #include <inttypes.h>
+#include <stddef.h>
 #include <time.h>
 
+// Broken-down times stored one field per array, as used by the
+// columnar conversion functions.  Years are stored in full and months
+// count from 1.  Any array may be NULL to skip storing that field.
+struct tz64_columns {
+    int32_t *year;
+    int8_t *mon;
+    int8_t *mday;
+    int8_t *hour;
+    int8_t *min;
+    int8_t *sec;
+    int16_t *yday;
+    int8_t *wday;
+    int32_t *utoff;
+    int8_t *isdst;
+};
+
+// A compact broken-down time, for callers that don't need a whole
+// struct tm.  Years are stored in full, months count from 1 and offset
+// is an index into the time zone's offsets, which tz64_fields_offset
+// looks up.
+struct tz64_fields {
+    int32_t year;
+    uint8_t mon;
+    uint8_t mday;
+    uint8_t hour;
+    uint8_t min;
+    uint8_t sec;
+    uint8_t wday;
+    uint16_t yday;
+    uint8_t offset;
+};
+
+// Select which members of struct tz64_fields to fill in.  Leaving out
+// the date and day of the year saves working out the year.
+#define TZ64_FIELD_DATE 0x01    // year, mon and mday
+#define TZ64_FIELD_TIME 0x02    // hour, min and sec
+#define TZ64_FIELD_WDAY 0x04
+#define TZ64_FIELD_YDAY 0x08
+#define TZ64_FIELD_OFFSET 0x10
+#define TZ64_FIELDS_ALL 0x1f
+
+// The offset from UTC in effect at some moment, and whether it's
+// daylight saving time.
+struct tz64_offset_info {
+    int32_t utoff;
+    int isdst;
+    const char *desig;
+};
+
+// A change from one offset to another.  ts is the first second of the
+// new offset.
+struct tz64_transition {
+    int64_t ts;
+    struct tz64_offset_info before;
+    struct tz64_offset_info after;
+};
+
+// How a local time relates to the transitions.  A local time skipped
+// when the clock moves forward doesn't exist, and one repeated when
+// it moves back is ambiguous.
+#define TZ64_LOCAL_NORMAL 0
+#define TZ64_LOCAL_AMBIGUOUS 1
+#define TZ64_LOCAL_NONEXISTENT 2
+
+// How tz64_resolve_local chooses between the two timestamps an
+// ambiguous or non-existent local time could stand for.
+#define TZ64_RESOLVE_EARLIEST 0         // the earlier one
+#define TZ64_RESOLVE_LATEST 1           // the later one
+#define TZ64_RESOLVE_REJECT 2           // neither: fail with EINVAL
+#define TZ64_RESOLVE_SHIFT_FORWARD 3    // the transition, or the earlier if ambiguous
+
+// A local time resolved to a timestamp.  If the local time is
+// ambiguous or doesn't exist then earliest and latest are the
+// timestamps it would be with the offsets before and after the
+// transition; otherwise they're both ts.
+struct tz64_resolution {
+    int64_t ts;
+    int64_t earliest;
+    int64_t latest;
+    int kind;
+};
+
+// Walks through the transitions in a range of time.  Set it up with
+// tz64_transition_iter_init; the fields are private.
+struct tz64_transition_iter {
+    const struct tz64 *tz;
+    int64_t ts;
+    int64_t end;
+};
+
+// Remembers where in a time zone's transitions and leap seconds the
+// last conversion landed, so that a conversion close to the previous
+// one doesn't need to search.  Set it up with tz64_cursor_init; the
+// fields are private.
+struct tz64_cursor {
+    const struct tz64 *tz;
+    uint32_t fwd_index;
+    uint32_t leap_index;
+    uint32_t rev_index;
+    uint32_t rev_leap_index;
+};
+
+// Controls how a time zone is prepared when it's loaded.  Set it up
+// with tz64_options_init and then adjust as needed.
+struct tz64_options {
+    // Timestamps from index_begin up to index_end are looked up in a
+    // direct index with one bucket per 2^index_shift seconds.  Set
+    // index_end to index_begin to do without the index.
+    int64_t index_begin;
+    int64_t index_end;
+    unsigned int index_shift;
+
+    // Nonzero to expand the daylight saving time rules into a table
+    // covering their full 400-year cycle.  This costs about 3 KB per
+    // time zone but converts times after the last explicit transition
+    // without a search.
+    int expand_rules;
+
+    // Nonzero to check only the headers of a time zone file when it's
+    // loaded, and decode the rest the first time the time zone is
+    // used.  Conversions fail with EINVAL if that turns out to be
+    // impossible.
+    int lazy;
+};
+
+void tz64_options_init(struct tz64_options *opts);
+
+// Time zones named by configure's --with-embedded-zones are compiled
+// into the library, and are returned without reading any files or
+// allocating any memory when asked for by name with the default
+// options.
 struct tz64 *tz64_alloc(const char *tz_desc);
+struct tz64 *tz64_alloc_with(const char *tz_desc, const struct tz64_options *opts);
+
+// Decode the contents of a TZif file held in memory.  The time zone
+// doesn't refer to the data, which may be freed straight away.
+// Returns NULL and sets errno to EINVAL if the data isn't valid.
+struct tz64 *tz64_alloc_from_memory(const void *data, size_t size, const struct tz64_options *opts);
+
 void tz64_free(struct tz64 *tz);
 
+// Look up a time zone in the process-wide registry, loading it as
+// tz64_alloc would if it isn't there already.  Descriptions naming the
+// same file share one time zone.  Lookups of time zones already
+// loaded don't take any locks.  Returns NULL and sets errno on
+// failure.  Release the time zone with tz64_release, not tz64_free.
+const struct tz64 *tz64_acquire(const char *tz_desc);
+void tz64_release(const struct tz64 *tz);
+
+// A bundle of time zones compiled ahead of time by tzbundle.  The
+// time zones a bundle hands out point into the bundle, which is
+// mapped into memory rather than read, and remain valid until it's
+// closed.  Open returns NULL and sets errno on failure; find returns
+// NULL and sets errno to ENOENT if there's no time zone by that name.
+struct tz64_bundle;
+struct tz64_bundle *tz64_bundle_open(const char *path);
+const struct tz64 *tz64_bundle_find(const struct tz64_bundle *bundle, const char *name);
+void tz64_bundle_close(struct tz64_bundle *bundle);
+
+// Write count time zones loaded from files by tz64_alloc to a bundle
+// at path, each under the corresponding name.  Time zones may appear
+// more than once under different names; each is stored only once.
+// Time zones made from POSIX TZ strings, found in bundles or compiled
+// into the library can't be written, and give EINVAL.  Returns 0 on
+// success, or -1 and sets errno on failure.
+int tz64_bundle_write(const char *path, const char *const *names, const struct tz64 *const *zones,
+                      size_t count);
+
+// Limit the memory used by time zones in the registry to about limit
+// bytes, evicting the least recently used of those not acquired when
+// it's exceeded.  Zero, the default, means no limit.
+void tz64_registry_set_limit(size_t limit);
+
 int64_t tz64_tm_to_ts(const struct tz64 *restrict tz, struct tm *tm);
 struct tm *tz64_ts_to_tm(const struct tz64 *restrict tz, int64_t ts, struct tm* restrict tm);
 
+// Convert between timestamps and broken-down time in UTC, as gmtime_r
+// and timegm do but with 64-bit timestamps and no time zone to look
+// anything up in.  tz64_timegm normalises tm as tz64_tm_to_ts does.
+// Both fail as their time zone counterparts do.
+struct tm *tz64_gmtime(int64_t ts, struct tm *restrict tm);
+int64_t tz64_timegm(struct tm *tm);
+
+// As above, but for count timestamps or broken-down times.  Both
+// return the number converted.
+size_t tz64_gmtime_batch(const int64_t *restrict ts, struct tm *restrict tm, size_t count);
+size_t tz64_timegm_batch(struct tm *restrict tm, int64_t *restrict ts, size_t count);
+
+// Look up the offset from UTC in effect at ts, without working out
+// the broken-down time.
+const struct tz64_offset_info *tz64_offset_at(const struct tz64 *restrict tz, int64_t ts,
+                                              struct tz64_offset_info *restrict info);
+
+// Convert ts to seconds since 1970-01-01 00:00:00 local time, not
+// counting leap seconds.  Returns -1 and sets errno if ts is out of
+// range.
+int64_t tz64_ts_to_local(const struct tz64 *restrict tz, int64_t ts);
+
+// As above, but for count timestamps.  Both return the number
+// converted, which is less than count only if a timestamp is out of
+// range.
+size_t tz64_offset_at_batch(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                            struct tz64_offset_info *restrict info, size_t count);
+size_t tz64_ts_to_local_batch(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                              int64_t *restrict local, size_t count);
+
+// Find the first transition after ts, or the latest one no later than
+// ts.  The offset in effect at ts stays in effect from the previous
+// transition until the next one.  Both return NULL and set errno to
+// ENOENT if there is no such transition.
+const struct tz64_transition *tz64_next_transition(const struct tz64 *restrict tz, int64_t ts,
+                                                   struct tz64_transition *restrict trans);
+const struct tz64_transition *tz64_prev_transition(const struct tz64 *restrict tz, int64_t ts,
+                                                   struct tz64_transition *restrict trans);
+
+// Iterate over the transitions from begin up to but not including end,
+// both explicit and derived from the daylight saving time rules.
+// tz64_transition_iter_next returns NULL once there are no more.
+void tz64_transition_iter_init(struct tz64_transition_iter *iter, const struct tz64 *tz,
+                               int64_t begin, int64_t end);
+const struct tz64_transition *tz64_transition_iter_next(struct tz64_transition_iter *restrict iter,
+                                                        struct tz64_transition *restrict trans);
+
+// Convert ts to compact broken-down time, filling in only the members
+// selected by mask.
+struct tz64_fields *tz64_ts_to_fields(const struct tz64 *restrict tz, int64_t ts,
+                                      struct tz64_fields *restrict fields, unsigned int mask);
+
+// As above, but for count timestamps.  Returns the number converted.
+size_t tz64_ts_to_fields_batch(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                               struct tz64_fields *restrict fields, size_t count, unsigned int mask);
+
+// Look up the offset recorded in fields.
+const struct tz64_offset_info *tz64_fields_offset(const struct tz64 *restrict tz,
+                                                  const struct tz64_fields *restrict fields,
+                                                  struct tz64_offset_info *restrict info);
+
+// Convert compact broken-down time to a timestamp as tz64_tm_to_ts
+// would, but without writing anything back.  The time of day is
+// midnight unless mask includes TZ64_FIELD_TIME, and the offset
+// settles ambiguous times if mask includes TZ64_FIELD_OFFSET.
+// Returns -1 and sets errno on failure.
+int64_t tz64_fields_to_ts(const struct tz64 *restrict tz, const struct tz64_fields *restrict fields,
+                          unsigned int mask);
+
+// Convert compact broken-down time in tz_from to the same moment in
+// tz_to.  The input is read as tz64_fields_to_ts reads it, and mask
+// also selects the members of out to fill in.  When the time stays on
+// the same day it isn't broken down again.  Returns NULL and sets
+// errno on failure.
+struct tz64_fields *tz64_convert(const struct tz64 *restrict tz_from, const struct tz64 *restrict tz_to,
+                                 const struct tz64_fields *restrict in, struct tz64_fields *restrict out,
+                                 unsigned int mask);
+
+// As above, but for count times.  Returns the number converted.
+size_t tz64_convert_batch(const struct tz64 *restrict tz_from, const struct tz64 *restrict tz_to,
+                          const struct tz64_fields *restrict in, struct tz64_fields *restrict out,
+                          size_t count, unsigned int mask);
+
+// Update tm, the broken-down time of ts_old, to that of ts_new.  When
+// the two are no more than a day apart and share an offset and leap
+// seconds, the fields are stepped rather than recomputed.  Returns NULL
+// and sets errno on failure.
+struct tm *tz64_tm_advance(const struct tz64 *restrict tz, struct tm *restrict tm, int64_t ts_old, int64_t ts_new);
+
+// The reverse: move tm, the broken-down time of ts, by delta seconds
+// of wall-clock time and return the new timestamp, as tz64_tm_to_ts
+// would after adding delta to tm_sec.  Returns -1 and sets errno on
+// failure.
+int64_t tz64_tm_advance_local(const struct tz64 *restrict tz, struct tm *restrict tm, int64_t ts, int64_t delta);
+
+// Resolve the local date and time in fields to a timestamp, settling
+// ambiguous and non-existent times by policy rather than by hints.
+// Fields out of their usual ranges are carried as tz64_tm_to_ts would;
+// wday, yday and offset are ignored.  Returns NULL and sets errno on
+// failure, including when policy is TZ64_RESOLVE_REJECT and the time
+// isn't normal, in which case *out is still filled in.
+const struct tz64_resolution *tz64_resolve_local(const struct tz64 *restrict tz,
+                                                 const struct tz64_fields *restrict fields, int policy,
+                                                 struct tz64_resolution *restrict out);
+
+// Convert count timestamps to broken-down time.  Returns the number
+// converted, which is less than count only if a conversion failed, in
+// which case errno indicates why.
+size_t tz64_ts_to_tm_batch(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                           struct tm *restrict tm, size_t count);
+
+// As above, but store each field of the broken-down times in its own
+// array.  Row i of each column corresponds to ts[i].
+size_t tz64_ts_to_columns(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                          const struct tz64_columns *restrict cols, size_t count);
+
+// The reverse: convert count rows of broken-down local time, one field
+// per array, to timestamps as tz64_tm_to_ts would.  The year, mon and
+// mday arrays are required; NULL hour, min or sec arrays read as zero.
+// The isdst and utoff arrays, if present, resolve ambiguous times as
+// tm_isdst and tm_gmtoff do; a NULL isdst array reads as -1.  Faster
+// when the rows are sorted.  Returns the number converted.
+size_t tz64_columns_to_ts(const struct tz64 *restrict tz, const struct tz64_columns *restrict cols,
+                          int64_t *restrict ts, size_t count);
+
+// Convert one timestamp to broken-down time in each of count time
+// zones, breaking it down only once.  Returns the number converted.
+size_t tz64_ts_to_tm_zones(const struct tz64 *const *zones, size_t count, int64_t ts, struct tm *restrict tm);
+
+// As tz64_ts_to_tm_batch, but faster when the timestamps are sorted
+// or nearly so.
+size_t tz64_ts_to_tm_sorted(const struct tz64 *restrict tz, const int64_t *restrict ts,
+                            struct tm *restrict tm, size_t count);
+
+// As tz64_ts_to_tm_batch, but with each timestamp converted in the
+// corresponding zone of the zones array.  The zones may repeat and
+// come in any order.
+size_t tz64_ts_to_tm_mixed(const struct tz64 *const *restrict zones, const int64_t *restrict ts,
+                           struct tm *restrict tm, size_t count);
+
+// Convert nanoseconds or microseconds since the epoch to broken-down
+// time, storing the fraction of a second in *nsec or *usec.
+struct tm *tz64_ns_to_tm(const struct tz64 *restrict tz, int64_t ns, struct tm *restrict tm,
+                         int32_t *restrict nsec);
+struct tm *tz64_us_to_tm(const struct tz64 *restrict tz, int64_t us, struct tm *restrict tm,
+                         int32_t *restrict usec);
+
+// As above, but for count times.  The fractions are not stored if nsec
+// or usec is NULL.  Returns the number converted.
+size_t tz64_ns_to_tm_batch(const struct tz64 *restrict tz, const int64_t *restrict ns,
+                           struct tm *restrict tm, int32_t *restrict nsec, size_t count);
+size_t tz64_us_to_tm_batch(const struct tz64 *restrict tz, const int64_t *restrict us,
+                           struct tm *restrict tm, int32_t *restrict usec, size_t count);
+
+// Convert broken-down time plus a fraction of a second to nanoseconds
+// or microseconds since the epoch.  Returns -1 and sets errno if the
+// result doesn't fit.
+int64_t tz64_tm_to_ns(const struct tz64 *restrict tz, struct tm *tm, int32_t nsec);
+int64_t tz64_tm_to_us(const struct tz64 *restrict tz, struct tm *tm, int32_t usec);
+
+void tz64_cursor_init(struct tz64_cursor *cursor, const struct tz64 *tz);
+struct tm *tz64_cursor_ts_to_tm(struct tz64_cursor *restrict cursor, int64_t ts, struct tm *restrict tm);
+int64_t tz64_cursor_tm_to_ts(struct tz64_cursor *cursor, struct tm *tm);
+
 #endif // TZ_H
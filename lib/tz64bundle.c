@@ -0,0 +1,511 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Bundles of precompiled time zones
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "tz64.h"
+#include "tz64file.h"
+
+#define BUNDLE_MAGIC "TZ64BNDL"
+#define BUNDLE_VERSION 1
+#define BUNDLE_BYTE_ORDER 0x01020304
+
+// Blocks start on cache-line boundaries.
+#define BUNDLE_ALIGN 64
+
+// Bundles at least this big are mapped at an address aligned for
+// transparent huge pages.
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// The pointer members of struct tz64, which a bundle stores as offsets
+// from the start of the time zone's block.  Zero stands for NULL,
+// since no table starts where the struct tz64 does.
+static const size_t pointer_members[] = {
+    offsetof(struct tz64, timestamps),
+    offsetof(struct tz64, local_edges),
+    offsetof(struct tz64, offset_map),
+    offsetof(struct tz64, offsets),
+    offsetof(struct tz64, leap_ts),
+    offsetof(struct tz64, rev_leap_ts),
+    offsetof(struct tz64, leap_secs),
+    offsetof(struct tz64, desig),
+    offsetof(struct tz64, extra_ts),
+    offsetof(struct tz64, extra_cycle),
+    offsetof(struct tz64, ts_eytz.values),
+    offsetof(struct tz64, ts_eytz.rank),
+    offsetof(struct tz64, leap_eytz.values),
+    offsetof(struct tz64, leap_eytz.rank),
+    offsetof(struct tz64, rev_leap_eytz.values),
+    offsetof(struct tz64, rev_leap_eytz.rank),
+    offsetof(struct tz64, buckets.fwd),
+    offsetof(struct tz64, buckets.rev),
+};
+
+#define POINTER_MEMBERS (sizeof(pointer_members) / sizeof(pointer_members[0]))
+
+struct tz64_bundle {
+    const char *data;
+    size_t size;
+    uint32_t name_count;
+    const struct tz_bundle_index *index;
+
+    // The time zone for each name, set up on first use.
+    struct tz64 **zones;
+};
+
+struct named_zone {
+    const char *name;
+    const struct tz64 *tz;
+};
+
+
+static uint64_t align_up(uint64_t offset)
+{
+    return (offset + BUNDLE_ALIGN - 1) & ~(uint64_t)(BUNDLE_ALIGN - 1);
+}
+
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(((const struct named_zone *)a)->name, ((const struct named_zone *)b)->name);
+}
+
+
+// Write len bytes and then zeros up to offset end.
+static int write_padded(FILE *out, const void *data, size_t len, uint64_t *offset, uint64_t end)
+{
+    static const char zeros[BUNDLE_ALIGN];
+    if (len != 0 && fwrite(data, len, 1, out) != 1) {
+        return -1;
+    }
+
+    *offset += len;
+    if (end > *offset && fwrite(zeros, end - *offset, 1, out) != 1) {
+        return -1;
+    }
+
+    *offset = (end > *offset) ? end : *offset;
+    return 0;
+}
+
+
+// Write a time zone's block with its pointers turned into offsets.
+// Fails if the time zone isn't a block of its own, as those found in
+// bundles or compiled into the library aren't and so have no size, or
+// if any pointer lies outside the block, as those of time zones made
+// from POSIX TZ strings do.
+static int write_block(FILE *out, const struct tz64 *tz, uint64_t *offset)
+{
+    if (tz->size < sizeof(struct tz64)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const char *base = (const char *)tz;
+    char *copy = malloc(tz->size);
+    if (copy == NULL) {
+        return -1;
+    }
+
+    memcpy(copy, tz, tz->size);
+    ((struct tz64 *)copy)->refs = 0;
+    ((struct tz64 *)copy)->pending = 0;
+    ((struct tz64 *)copy)->lazy = NULL;
+    for (size_t i = 0; i < POINTER_MEMBERS; i++) {
+        const char *p;
+        memcpy(&p, copy + pointer_members[i], sizeof(p));
+        if (p != NULL && (p < base + sizeof(struct tz64) || p > base + tz->size)) {
+            free(copy);
+            errno = EINVAL;
+            return -1;
+        }
+
+        const uintptr_t rel = (p == NULL) ? 0 : (uintptr_t)(p - base);
+        memcpy(copy + pointer_members[i], &rel, sizeof(rel));
+    }
+
+    const int res = write_padded(out, copy, tz->size, offset, align_up(*offset + tz->size));
+    free(copy);
+    return res;
+}
+
+
+int tz64_bundle_write(const char *path, const char *const *names, const struct tz64 *const *zones,
+                      size_t count)
+{
+    if (count > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Sort the names, and find each distinct time zone.
+    struct named_zone *sorted = malloc(count * sizeof(struct named_zone));
+    const struct tz64 **distinct = malloc(count * sizeof(const struct tz64 *));
+    uint64_t *block_offsets = malloc(count * sizeof(uint64_t));
+    struct tz_bundle_index *index = malloc(count * sizeof(struct tz_bundle_index));
+    FILE *out = NULL;
+    if ((count != 0) && (sorted == NULL || distinct == NULL || block_offsets == NULL || index == NULL)) {
+        goto err;
+    }
+
+    // Lazily loaded time zones are written as decoded.
+    for (size_t i = 0; i < count; i++) {
+        sorted[i].name = names[i];
+        sorted[i].tz = zones[i];
+        if (zones[i]->lazy != NULL) {
+            if (tz_load_lazy(zones[i]) != 0) {
+                goto err;
+            }
+            sorted[i].tz = zones[i]->lazy->block;
+        }
+    }
+    qsort(sorted, count, sizeof(struct named_zone), compare_names);
+
+    for (size_t i = 1; i < count; i++) {
+        if (strcmp(sorted[i - 1].name, sorted[i].name) == 0) {
+            errno = EINVAL;
+            goto err;
+        }
+    }
+
+    // Lay out the blocks after the header, and the index and names
+    // after the blocks.
+    struct tz_bundle_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(header.magic));
+    header.version = BUNDLE_VERSION;
+    header.byte_order = BUNDLE_BYTE_ORDER;
+    header.struct_size = sizeof(struct tz64);
+    header.name_count = count;
+
+    size_t distinct_count = 0;
+    uint64_t offset = align_up(sizeof(header));
+    for (size_t i = 0; i < count; i++) {
+        size_t j = 0;
+        while (j < distinct_count && distinct[j] != sorted[i].tz) {
+            j++;
+        }
+
+        if (j == distinct_count) {
+            distinct[distinct_count] = sorted[i].tz;
+            block_offsets[distinct_count++] = offset;
+            offset = align_up(offset + sorted[i].tz->size);
+        }
+
+        index[i].block_offset = block_offsets[j];
+    }
+
+    header.index_offset = offset;
+    offset += count * sizeof(struct tz_bundle_index);
+    for (size_t i = 0; i < count; i++) {
+        index[i].name_offset = offset;
+        offset += strlen(sorted[i].name) + 1;
+    }
+    header.size = offset;
+
+    // Write it all out.
+    out = fopen(path, "wb");
+    if (out == NULL) {
+        goto err;
+    }
+
+    offset = 0;
+    if (write_padded(out, &header, sizeof(header), &offset, align_up(sizeof(header))) != 0) {
+        goto err;
+    }
+
+    for (size_t j = 0; j < distinct_count; j++) {
+        if (write_block(out, distinct[j], &offset) != 0) {
+            goto err;
+        }
+    }
+
+    if (write_padded(out, index, count * sizeof(struct tz_bundle_index), &offset, 0) != 0) {
+        goto err;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (write_padded(out, sorted[i].name, strlen(sorted[i].name) + 1, &offset, 0) != 0) {
+            goto err;
+        }
+    }
+
+    if (fclose(out) != 0) {
+        out = NULL;
+        goto err;
+    }
+
+    free(sorted);
+    free(distinct);
+    free(block_offsets);
+    free(index);
+    return 0;
+
+err:
+    {
+        const int err = errno;
+        if (out != NULL) {
+            (void)fclose(out);
+        }
+        free(sorted);
+        free(distinct);
+        free(block_offsets);
+        free(index);
+        errno = err;
+    }
+    return -1;
+}
+
+
+// Map a file read-only.  Big files are placed at an address aligned
+// for huge pages, and the kernel is asked to use them, which on
+// kernels that support huge pages for read-only file mappings saves
+// TLB misses when many time zones are in use.
+static const char *map_file(int fd, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+    if (size >= HUGE_PAGE_SIZE) {
+        // Reserve enough address space to align the mapping within.
+        char *reserve = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserve != MAP_FAILED) {
+            char *aligned = (char *)(((uintptr_t)reserve + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+            char *data = mmap(aligned, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+            if (data == MAP_FAILED) {
+                (void)munmap(reserve, size + HUGE_PAGE_SIZE);
+                return NULL;
+            }
+
+            // Give back the parts of the reservation either side.
+            const size_t page = sysconf(_SC_PAGESIZE);
+            const size_t used = (size + page - 1) & ~(page - 1);
+            if (aligned > reserve) {
+                (void)munmap(reserve, aligned - reserve);
+            }
+            if (reserve + size + HUGE_PAGE_SIZE > aligned + used) {
+                (void)munmap(aligned + used, reserve + size + HUGE_PAGE_SIZE - (aligned + used));
+            }
+
+            (void)madvise(data, size, MADV_HUGEPAGE);
+            return data;
+        }
+    }
+#endif
+
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    return (data == MAP_FAILED) ? NULL : data;
+}
+
+
+struct tz64_bundle *tz64_bundle_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0) {
+        const int err = errno;
+        (void)close(fd);
+        errno = err;
+        return NULL;
+    }
+
+    if (statbuf.st_size < (off_t)sizeof(struct tz_bundle_header)) {
+        (void)close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const size_t size = statbuf.st_size;
+    const char *data = map_file(fd, size);
+    const int err = errno;
+    (void)close(fd);
+    if (data == NULL) {
+        errno = err;
+        return NULL;
+    }
+
+    // Check that the bundle was written for this host and this
+    // version of the library, and that the index fits.
+    const struct tz_bundle_header *header = (const struct tz_bundle_header *)data;
+    if (memcmp(header->magic, BUNDLE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != BUNDLE_VERSION ||
+        header->byte_order != BUNDLE_BYTE_ORDER ||
+        header->struct_size != sizeof(struct tz64) ||
+        header->size != size ||
+        header->index_offset % sizeof(uint64_t) != 0 ||
+        header->index_offset > size ||
+        (size - header->index_offset) / sizeof(struct tz_bundle_index) < header->name_count ||
+        data[size - 1] != '\0') {
+        (void)munmap((void *)data, size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct tz64_bundle *bundle = malloc(sizeof(struct tz64_bundle));
+    struct tz64 **zones = calloc(header->name_count + 1, sizeof(struct tz64 *));
+    if (bundle == NULL || zones == NULL) {
+        free(bundle);
+        free(zones);
+        (void)munmap((void *)data, size);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    bundle->data = data;
+    bundle->size = size;
+    bundle->name_count = header->name_count;
+    bundle->index = (const struct tz_bundle_index *)(data + header->index_offset);
+    bundle->zones = zones;
+    return bundle;
+}
+
+
+// Make a struct tz64 for the block at offset, with its offsets turned
+// back into pointers into the bundle.
+static struct tz64 *relocate(const struct tz64_bundle *bundle, uint64_t offset)
+{
+    if (offset % BUNDLE_ALIGN != 0 || offset > bundle->size ||
+        bundle->size - offset < sizeof(struct tz64)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct tz64 *tz = malloc(sizeof(struct tz64));
+    if (tz == NULL) {
+        return NULL;
+    }
+
+    const char *base = bundle->data + offset;
+    memcpy(tz, base, sizeof(struct tz64));
+
+    // Blocks are written decoded, so a pending load or a pointer to
+    // its state means the file is damaged.
+    if (tz->size > bundle->size - offset || tz->pending != 0 || tz->lazy != NULL) {
+        free(tz);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    char *fields = (char *)tz;
+    for (size_t i = 0; i < POINTER_MEMBERS; i++) {
+        uintptr_t rel;
+        memcpy(&rel, fields + pointer_members[i], sizeof(rel));
+        if (rel > tz->size) {
+            free(tz);
+            errno = EINVAL;
+            return NULL;
+        }
+
+        const char *p = (rel == 0) ? NULL : base + rel;
+        memcpy(fields + pointer_members[i], &p, sizeof(p));
+    }
+
+    // The tables stay in the bundle, so the time zone isn't a block
+    // of its own: tz64_free leaves it be and it can't be re-bundled.
+    tz->size = 0;
+    tz->refs = 0;
+    return tz;
+}
+
+
+const struct tz64 *tz64_bundle_find(const struct tz64_bundle *bundle, const char *name)
+{
+    // Binary search the index.
+    uint32_t lo = 0, hi = bundle->name_count;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        const uint64_t name_offset = bundle->index[mid].name_offset;
+        if (name_offset >= bundle->size) {
+            errno = EINVAL;
+            return NULL;
+        }
+
+        const int cmp = strcmp(name, bundle->data + name_offset);
+        if (cmp == 0) {
+            lo = mid;
+            break;
+        }
+
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    if (lo >= hi) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    // Set up the time zone the first time it's asked for.  If two
+    // threads race to do so then one copy is thrown away.
+    struct tz64 *tz = __atomic_load_n(&bundle->zones[lo], __ATOMIC_ACQUIRE);
+    if (tz != NULL) {
+        return tz;
+    }
+
+    struct tz64 *fresh = relocate(bundle, bundle->index[lo].block_offset);
+    if (fresh == NULL) {
+        return NULL;
+    }
+
+    if (!__atomic_compare_exchange_n(&bundle->zones[lo], &tz, fresh, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(fresh);
+        return tz;
+    }
+
+    return fresh;
+}
+
+
+void tz64_bundle_close(struct tz64_bundle *bundle)
+{
+    if (bundle == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < bundle->name_count; i++) {
+        free(bundle->zones[i]);
+    }
+
+    free(bundle->zones);
+    (void)munmap((void *)bundle->data, bundle->size);
+    free(bundle);
+}
+
+////////////////////////////////////////////////////////////////////////
+// End of tz64bundle.c
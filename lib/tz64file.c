@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <inttypes.h>
 #include <sys/types.h>
@@ -37,14 +38,28 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
+#include <pthread.h>
 #include "constants.h"
 #include "tz64.h"
 #include "tz64file.h"
 
 #define MAGIC "TZif"
-#define ZONE_DIR "/usr/share/zoneinfo"
 #define MAX_TZSTR_SIZE 63
 
+// By default, index 1970 through 2099 in buckets of about 12 days.
+#define DEFAULT_INDEX_BEGIN 0
+#define DEFAULT_INDEX_END INT64_C(4102444800)
+#define DEFAULT_INDEX_SHIFT 20
+
+// The expanded rule table covers transitions -2 through 801.
+#define EXTRA_CYCLE_SIZE 804
+
+// The number of hash chains in the registry.
+#define REGISTRY_BUCKETS 1024
+
+// The reference count of a time zone the registry has evicted.
+#define REFS_DEAD UINT32_MAX
+
 enum rule_type {
     RT_NONE,
     RT_MONTH,
@@ -68,7 +83,11 @@ struct rule {
 
 extern const char *progname;
 
+// Serialises the decoding of lazily loaded time zones.
+static pthread_mutex_t lazy_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static const int64_t utc_timestamps[1] = { INT64_MIN };
+static const int64_t utc_local_edges[2] = { INT64_MIN, INT64_MIN };
 static const struct tz_offset utc_offsets[1] = { { 0, 0, 0 } };
 static const uint8_t utc_offset_map[1] = { 0 };
 
@@ -76,6 +95,7 @@ struct tz64 tz_utc = {
     .ts_count = 1,
     .leap_count = 0,
     .timestamps = utc_timestamps,
+    .local_edges = utc_local_edges,
     .offsets = utc_offsets,
     .offset_map = utc_offset_map,
     .leap_ts = NULL,
@@ -83,6 +103,7 @@ struct tz64 tz_utc = {
     .leap_secs = NULL,
     .desig = "UTC",
     .extra_ts = NULL,
+    .extra_cycle = NULL,
 };
 
 
@@ -570,6 +591,134 @@ static int populate_extra_ts(int32_t *ts, const struct tz64 *tz, const struct ru
 }
 
 
+// Place the sorted timestamps belonging in the subtree rooted at node
+// k of an Eytzinger layout, starting with sorted[i].  Returns the
+// index of the first timestamp not placed.
+static uint32_t fill_eytzinger(int64_t *values, uint32_t *rank, const int64_t *sorted,
+                               uint32_t count, uint32_t i, uint32_t k)
+{
+    if (k <= count) {
+        i = fill_eytzinger(values, rank, sorted, count, i, 2 * k);
+        values[k] = sorted[i];
+        rank[k] = i++;
+        i = fill_eytzinger(values, rank, sorted, count, i, 2 * k + 1);
+    }
+
+    return i;
+}
+
+
+static void build_eytzinger(struct tz_eytzinger *eytz, int64_t *values, uint32_t *rank,
+                            const int64_t *sorted, uint32_t count)
+{
+    values[0] = INT64_MIN;
+    rank[0] = count;
+    fill_eytzinger(values, rank, sorted, count, 0, 1);
+
+    eytz->values = values;
+    eytz->rank = rank;
+}
+
+
+// Work out how many buckets are needed to index the transitions from
+// the options' index_begin up to the earlier of its index_end and
+// last_ts.  Returns -1 if that's unreasonably many.
+static int64_t count_buckets(const struct tz64_options *opts, uint32_t timecnt, int64_t last_ts)
+{
+    // Local-time edges, two per transition, are indexed with 16 bits.
+    if (timecnt == 0 || timecnt >= UINT16_MAX / 2) {
+        return 0;
+    }
+
+    const int64_t end = (opts->index_end < last_ts) ? opts->index_end : last_ts;
+    if (end <= opts->index_begin) {
+        return 0;
+    }
+
+    if (opts->index_shift >= 63) {
+        return -1;
+    }
+
+    const uint64_t span = (uint64_t)end - (uint64_t)opts->index_begin;
+    const uint64_t count = ((span - 1) >> opts->index_shift) + 1;
+    return (count > UINT32_MAX) ? -1 : (int64_t)count;
+}
+
+
+// Work out the local times at which each transition takes effect.
+// Transition i moves the clock from the previous offset's local time
+// to its own, skipping the local times in between if the clock moves
+// forward (a gap) or repeating them if it moves back (a fold).  Edges
+// 2i and 2i + 1 are the earlier and later of those two local times, so
+// a local time that falls between them is in a gap or fold, and one
+// that falls after edge 2i + 1 is unambiguously in transition i's
+// offset.
+static void build_local_edges(struct tz64 *tz, int64_t *edges)
+{
+    edges[0] = INT64_MIN;
+    edges[1] = INT64_MIN;
+    for (uint32_t i = 1; i < tz->ts_count; i++) {
+        const int64_t before = tz->timestamps[i] + tz->offsets[tz->offset_map[i - 1]].utoff;
+        const int64_t after = tz->timestamps[i] + tz->offsets[tz->offset_map[i]].utoff;
+        int64_t lo = (before < after) ? before : after;
+        int64_t hi = (before < after) ? after : before;
+
+        // Keep the edges sorted even if transitions are crowded
+        // together.
+        lo = (lo < edges[2 * i - 1]) ? edges[2 * i - 1] : lo;
+        hi = (hi < lo) ? lo : hi;
+        edges[2 * i] = lo;
+        edges[2 * i + 1] = hi;
+    }
+
+    tz->local_edges = edges;
+}
+
+
+// Fill in the bucket index by walking through the transitions in
+// order.
+static void build_buckets(struct tz64 *tz, const struct tz64_options *opts, uint32_t count,
+                          uint16_t *fwd, uint16_t *rev)
+{
+    uint32_t i = 0, j = 0;
+    for (uint32_t b = 0; b < count; b++) {
+        const int64_t start = opts->index_begin + ((int64_t)b << opts->index_shift);
+        while (i + 1 < tz->ts_count && tz->timestamps[i + 1] <= start) {
+            i++;
+        }
+
+        while (j + 1 < 2 * tz->ts_count && tz->local_edges[j + 1] <= start) {
+            j++;
+        }
+
+        fwd[b] = i;
+        rev[b] = j;
+    }
+
+    tz->buckets.begin = opts->index_begin;
+    tz->buckets.end = opts->index_begin + ((int64_t)count << opts->index_shift);
+    tz->buckets.count = count;
+    tz->buckets.shift = opts->index_shift;
+    tz->buckets.fwd = fwd;
+    tz->buckets.rev = rev;
+}
+
+
+// Expand the 14 representative years of transitions into the full
+// 400-year cycle.  Transition i is stored relative to i half-years
+// after 2001-01-01 so that it fits in 32 bits.
+static const int32_t *expand_rules(int32_t *cycle, const int32_t *extra_ts)
+{
+    for (int i = -2; i < EXTRA_CYCLE_SIZE - 2; i++) {
+        const int year = (i - (i & 1)) / 2;
+        const int64_t ts = tz64_year_starts[year] + extra_ts[tz64_year_types[year] * 2 + (i & 1)];
+        cycle[i + 2] = ts - i * avg_secs_per_half_year;
+    }
+
+    return cycle + 2;
+}
+
+
 size_t tz_header_data_len(const struct tz_header *header, size_t time_size)
 {
     return
@@ -594,10 +743,11 @@ void tz_header_fix_endian(struct tz_header *header)
 }
 
 
-static struct tz64 *process_tzfile(const char *path, const char *data, off_t size)
+// Check the headers of a TZif file, and that it's long enough for the
+// data they describe.  Returns a pointer to the v2 data, with the v2
+// header in header, or NULL and sets errno if the file is no good.
+static const char *check_headers(const char *data, const char *end, struct tz_header *header)
 {
-    const char *end = data + size;
-
     if (data + sizeof(struct tz_header) >= end) {
         errno = EINVAL;
         return NULL;
@@ -618,13 +768,12 @@ static struct tz64 *process_tzfile(const char *path, const char *data, off_t siz
     }
 
     // Make a copy of the header and adjust the byte order.
-    struct tz_header header;
-    memcpy(&header, data, sizeof(header));
+    memcpy(header, data, sizeof(*header));
     data += sizeof(struct tz_header);
-    tz_header_fix_endian(&header);
+    tz_header_fix_endian(header);
 
     // Make sure the v1 data is present and skip it.
-    const size_t v1_size = tz_header_data_len(&header, sizeof(int32_t));
+    const size_t v1_size = tz_header_data_len(header, sizeof(int32_t));
     if (end - data < v1_size) {
         errno = EINVAL;
         return NULL;
@@ -638,27 +787,61 @@ static struct tz64 *process_tzfile(const char *path, const char *data, off_t siz
     }
 
     // Make a copy of the v2 header and adjust the byte order.
-    memcpy(&header, data, sizeof(struct tz_header));
-    data += sizeof(header);
-    tz_header_fix_endian(&header);
+    memcpy(header, data, sizeof(struct tz_header));
+    data += sizeof(*header);
+    tz_header_fix_endian(header);
 
     // Check the second header's magic.
-    if (memcmp(header.magic, MAGIC, strlen(MAGIC)) != 0) {
+    if (memcmp(header->magic, MAGIC, strlen(MAGIC)) != 0) {
         errno = EINVAL;
         return NULL;
     }
 
     // Make sure the file is big enough for the v2 data.
-    size_t v2_size = tz_header_data_len(&header, sizeof(int64_t));
+    size_t v2_size = tz_header_data_len(header, sizeof(int64_t));
     if (end - data < v2_size) {
         errno = EINVAL;
         return NULL;
     }
 
+    return data;
+}
+
+
+static struct tz64 *process_tzfile(const char *path, const char *data, off_t size,
+                                   const struct tz64_options *opts)
+{
+    const char *end = data + size;
+    struct tz_header header;
+    data = check_headers(data, end, &header);
+    if (data == NULL) {
+        return NULL;
+    }
+
+    // Size the bucket index, which needn't extend past the last
+    // transition.
+    int64_t last_ts = INT64_MIN;
+    if (header.timecnt != 0) {
+        memcpy(&last_ts, data + (header.timecnt - 1) * sizeof(int64_t), sizeof(last_ts));
+        last_ts = be64toh(last_ts);
+    }
+
+    const int64_t bucket_count = count_buckets(opts, header.timecnt, last_ts);
+    if (bucket_count < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
     // Allocate memory for the v2 data.
+    const size_t leap_eytz_count = (header.leapcnt == 0) ? 0 : (header.leapcnt + 2);
     size_t block_size =
         sizeof(struct tz64) +
         (header.timecnt + 1) * sizeof(int64_t) +
+        (header.timecnt + 1) * 2 * sizeof(int64_t) +
+        (header.timecnt + 2) * (sizeof(int64_t) + sizeof(uint32_t)) +
+        leap_eytz_count * 2 * (sizeof(int64_t) + sizeof(uint32_t)) +
+        bucket_count * 2 * sizeof(uint16_t) +
+        (opts->expand_rules ? EXTRA_CYCLE_SIZE * sizeof(int32_t) : 0) +
         header.typecnt * sizeof(struct tz_offset) +
         (header.leapcnt + 1) * sizeof(int64_t) +
         (header.leapcnt + 1) * sizeof(int64_t) +
@@ -672,11 +855,20 @@ static struct tz64 *process_tzfile(const char *path, const char *data, off_t siz
     }
 
     struct tz64 *tz = (struct tz64 *)block;
+    tz->size = block_size;
     block += sizeof(struct tz64);
 
     // Set up pointers to the various fields.
     int64_t *timestamps = (int64_t *)block;
     block += (header.timecnt + 1) * sizeof(int64_t);
+    int64_t *local_edges = (int64_t *)block;
+    block += (header.timecnt + 1) * 2 * sizeof(int64_t);
+    int64_t *ts_eytz = (int64_t *)block;
+    block += (header.timecnt + 2) * sizeof(int64_t);
+    int64_t *leap_eytz = (int64_t *)block;
+    block += leap_eytz_count * sizeof(int64_t);
+    int64_t *rev_leap_eytz = (int64_t *)block;
+    block += leap_eytz_count * sizeof(int64_t);
     struct tz_offset *offsets = (struct tz_offset *)block;
     block += header.typecnt * sizeof(struct tz_offset);
     int64_t *leap_ts = NULL;
@@ -692,6 +884,18 @@ static struct tz64 *process_tzfile(const char *path, const char *data, off_t siz
     }
     int32_t *extra_ts = (int32_t *)block;
     block += days_per_week * 2 * 2 * sizeof(int32_t);
+    int32_t *extra_cycle = (int32_t *)block;
+    block += opts->expand_rules ? EXTRA_CYCLE_SIZE * sizeof(int32_t) : 0;
+    uint32_t *ts_rank = (uint32_t *)block;
+    block += (header.timecnt + 2) * sizeof(uint32_t);
+    uint32_t *leap_rank = (uint32_t *)block;
+    block += leap_eytz_count * sizeof(uint32_t);
+    uint32_t *rev_leap_rank = (uint32_t *)block;
+    block += leap_eytz_count * sizeof(uint32_t);
+    uint16_t *fwd_buckets = (uint16_t *)block;
+    block += bucket_count * sizeof(uint16_t);
+    uint16_t *rev_buckets = (uint16_t *)block;
+    block += bucket_count * sizeof(uint16_t);
     uint8_t *offset_map = (uint8_t *)block + 2;
     block += 2 + header.timecnt + 1;
     char *desig = block;
@@ -832,6 +1036,17 @@ static struct tz64 *process_tzfile(const char *path, const char *data, off_t siz
         tz->ts_count--;
     }
 
+    // Lay out the timestamps and leap seconds for faster searching.
+    build_eytzinger(&tz->ts_eytz, ts_eytz, ts_rank, tz->timestamps, tz->ts_count);
+    if (tz->leap_count != 0) {
+        build_eytzinger(&tz->leap_eytz, leap_eytz, leap_rank, tz->leap_ts, tz->leap_count);
+    }
+
+    // Work out the local-time edges of the transitions, and index the
+    // transitions most likely to be looked up.
+    build_local_edges(tz, local_edges);
+    build_buckets(tz, opts, bucket_count, fwd_buckets, rev_buckets);
+
     // Parse the tz string.
     if (tzbuf[0] != '\0') {
         struct rule rules[2];
@@ -882,6 +1097,9 @@ static struct tz64 *process_tzfile(const char *path, const char *data, off_t siz
                 tz->extra_ts = extra_ts;
                 offset_map[-2] = rules[1 - adj].offset_idx;
                 offset_map[-1] = rules[adj].offset_idx;
+                if (opts->expand_rules) {
+                    tz->extra_cycle = expand_rules(extra_cycle, extra_ts);
+                }
 
                 // Check that the last explicit transition matches the
                 // rule in effect at that moment.
@@ -908,6 +1126,10 @@ static struct tz64 *process_tzfile(const char *path, const char *data, off_t siz
     }
 
     tz->rev_leap_ts = rev_leap_ts;
+    if (tz->leap_count != 0) {
+        build_eytzinger(&tz->rev_leap_eytz, rev_leap_eytz, rev_leap_rank, tz->rev_leap_ts, tz->leap_count);
+    }
+
     return tz;
 
 err:
@@ -916,7 +1138,46 @@ err:
 }
 
 
-static int load_tz(struct tz64 **tz_out, const char *path)
+// Make a time zone that keeps a copy of the data and decodes it when
+// it's first used, checking only the headers for now.
+static struct tz64 *make_lazy_tz(const char *data, off_t size, const struct tz64_options *opts)
+{
+    struct tz_header header;
+    if (check_headers(data, data + size, &header) == NULL) {
+        return NULL;
+    }
+
+    const size_t len = sizeof(struct tz64) + sizeof(struct tz_lazy);
+    char *block = calloc(1, len);
+    char *copy = malloc(size);
+    if (block == NULL || copy == NULL) {
+        free(block);
+        free(copy);
+        return NULL;
+    }
+
+    struct tz64 *tz = (struct tz64 *)block;
+    struct tz_lazy *lazy = (struct tz_lazy *)(block + sizeof(struct tz64));
+    memcpy(copy, data, size);
+    lazy->data = copy;
+    lazy->size = size;
+    lazy->opts = *opts;
+    tz->size = len;
+    tz->pending = 1;
+    tz->lazy = lazy;
+    return tz;
+}
+
+
+// Decode a TZif file now or later, as the options say.
+static struct tz64 *decode_tzfile(const char *path, const char *data, off_t size,
+                                  const struct tz64_options *opts)
+{
+    return opts->lazy ? make_lazy_tz(data, size, opts) : process_tzfile(path, data, size, opts);
+}
+
+
+static int load_tz(struct tz64 **tz_out, const char *path, const struct tz64_options *opts)
 {
     // Open the file.
     int fd = open(path, O_RDONLY);
@@ -941,7 +1202,7 @@ static int load_tz(struct tz64 **tz_out, const char *path)
     }
 
     // Decode the data in the file.
-    *tz_out = process_tzfile(path, data, statbuf.st_size);
+    *tz_out = decode_tzfile(path, data, statbuf.st_size, opts);
 
     // Clean up.
     int res = munmap(data, statbuf.st_size);
@@ -956,9 +1217,10 @@ static int load_tz(struct tz64 **tz_out, const char *path)
 
 static struct tz64 *make_tz_from_one_rule(const struct rule *rule, int isdst)
 {
-    size_t len = sizeof(struct tz64) + sizeof(struct tz_offset) + 1 + strlen(rule->desig);
+    size_t len = sizeof(struct tz64) + sizeof(struct tz_offset) + 1 + strlen(rule->desig) + 1;
     char *block = calloc(1, len);
     struct tz64 *tz = (struct tz64 *)block;
+    tz->size = len;
     block += sizeof(struct tz64);
     struct tz_offset *offsets = (struct tz_offset *)block;
     block += sizeof(struct tz_offset);
@@ -973,6 +1235,7 @@ static struct tz64 *make_tz_from_one_rule(const struct rule *rule, int isdst)
 
     tz->ts_count = 1;
     tz->timestamps = utc_timestamps;
+    tz->local_edges = utc_local_edges;
     tz->offset_map = offset_map;
     tz->offsets = offsets;
     tz->desig = desig;
@@ -980,23 +1243,27 @@ static struct tz64 *make_tz_from_one_rule(const struct rule *rule, int isdst)
 }
 
 
-static struct tz64 *make_tz_from_two_rules(const struct rule *rules)
+static struct tz64 *make_tz_from_two_rules(const struct rule *rules, const struct tz64_options *opts)
 {
     // Deal with the case of two rules.
     size_t len =
         sizeof(struct tz64) +
         sizeof(struct tz_offset) * 2 + 4 +
         sizeof(int32_t) * days_per_week * 2 * 2 +
+        (opts->expand_rules ? EXTRA_CYCLE_SIZE * sizeof(int32_t) : 0) +
         strlen(rules[0].desig) + 1 + strlen(rules[1].desig) + 1;
 
     char *block = calloc(1, len);
     struct tz64 *tz = (struct tz64 *)block;
+    tz->size = len;
     block += sizeof(struct tz64);
     struct tz_offset *offsets = (struct tz_offset *)block;
     block += sizeof(struct tz_offset) * 2;
     tz->extra_ts = (int32_t *)block;
     int32_t *extra_ts = (int32_t *)block;
     block += sizeof(int32_t) * days_per_week * 2 * 2;
+    int32_t *extra_cycle = (int32_t *)block;
+    block += opts->expand_rules ? EXTRA_CYCLE_SIZE * sizeof(int32_t) : 0;
     uint8_t *offset_map = (uint8_t *)block + 2;
     block += 4;
     char *desig = block;
@@ -1016,6 +1283,7 @@ static struct tz64 *make_tz_from_two_rules(const struct rule *rules)
 
     tz->ts_count = 1;
     tz->timestamps = utc_timestamps;
+    tz->local_edges = utc_local_edges;
     tz->offset_map = offset_map;
     tz->offsets = offsets;
     tz->desig = desig;
@@ -1024,11 +1292,15 @@ static struct tz64 *make_tz_from_two_rules(const struct rule *rules)
     int adj = populate_extra_ts(extra_ts, tz, rules);
     offset_map[-2] = rules[1 - adj].offset_idx;
     offset_map[-1] = rules[adj].offset_idx;
+    if (opts->expand_rules) {
+        tz->extra_cycle = expand_rules(extra_cycle, extra_ts);
+    }
+
     return tz;
 }
 
 
-static struct tz64 *make_tz_from_string(const char *str)
+static struct tz64 *make_tz_from_string(const char *str, const struct tz64_options *opts)
 {
     // Try to parse the string.
     struct rule rules[2];
@@ -1043,7 +1315,7 @@ static struct tz64 *make_tz_from_string(const char *str)
     } else {
         rules[0].offset_idx = 0;
         rules[1].offset_idx = 1;
-        return make_tz_from_two_rules(rules);
+        return make_tz_from_two_rules(rules, opts);
     }
 }
 
@@ -1056,6 +1328,7 @@ static struct tz64 *make_utc()
     }
 
     memcpy(tz, &tz_utc, sizeof(struct tz64));
+    tz->size = sizeof(struct tz64);
     return tz;
 }
 
@@ -1081,21 +1354,78 @@ static char *mkpath(char *buffer, size_t buflen, const char *rest)
 }
 
 
+// Returns true if the options give the same tables as the defaults,
+// which time zones compiled into the library were loaded with.  They
+// may still ask for laziness, which is moot for those time zones.
+static bool is_default(const struct tz64_options *opts)
+{
+    return opts->index_begin == DEFAULT_INDEX_BEGIN &&
+        opts->index_end == DEFAULT_INDEX_END &&
+        opts->index_shift == DEFAULT_INDEX_SHIFT &&
+        !opts->expand_rules;
+}
+
+
+// Find a time zone compiled into the library by name, with or without
+// a leading colon.  Returns NULL if there's no such time zone.
+static struct tz64 *find_embedded(const char *tz_desc)
+{
+    const char *name = (*tz_desc == ':') ? tz_desc + 1 : tz_desc;
+    size_t lo = 0, hi = tz_embedded_count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const int cmp = strcmp(name, tz_embedded_zones[mid].name);
+        if (cmp == 0) {
+            return (struct tz64 *)tz_embedded_zones[mid].tz;
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+
+void tz64_options_init(struct tz64_options *opts)
+{
+    opts->index_begin = DEFAULT_INDEX_BEGIN;
+    opts->index_end = DEFAULT_INDEX_END;
+    opts->index_shift = DEFAULT_INDEX_SHIFT;
+    opts->expand_rules = 0;
+    opts->lazy = 0;
+}
+
+
 struct tz64 *tz64_alloc(const char *tz_desc)
+{
+    return tz64_alloc_with(tz_desc, NULL);
+}
+
+
+struct tz64 *tz64_alloc_with(const char *tz_desc, const struct tz64_options *opts)
 {
     char pathbuf[256];
     struct tz64 *tz;
 
+    // NULL options mean the defaults.
+    struct tz64_options defaults;
+    if (opts == NULL) {
+        tz64_options_init(&defaults);
+        opts = &defaults;
+    }
+
     // NULL indicates localtime.
     if (tz_desc == NULL) {
         // Try /usr/share/zoneinfo/localtime
-        int res = load_tz(&tz, mkpath(pathbuf, sizeof(pathbuf), "localtime"));
+        int res = load_tz(&tz, mkpath(pathbuf, sizeof(pathbuf), "localtime"), opts);
         if (res == 0) {
             return tz;
         }
 
         // Failing that, try /etc/localtime
-        res = load_tz(&tz, "/etc/localtime");
+        res = load_tz(&tz, "/etc/localtime", opts);
         if (res == 0) {
             return tz;
         }
@@ -1104,7 +1434,7 @@ struct tz64 *tz64_alloc(const char *tz_desc)
     // An empty string means UTC (if no localtime then use UTC).
     if (tz_desc == NULL || *tz_desc == '\0') {
         // Then try UTC.
-        int res = load_tz(&tz, mkpath(pathbuf, sizeof(pathbuf), "UTC"));
+        int res = load_tz(&tz, mkpath(pathbuf, sizeof(pathbuf), "UTC"), opts);
         if (res == 0) {
             return tz;
         }
@@ -1113,13 +1443,21 @@ struct tz64 *tz64_alloc(const char *tz_desc)
         return make_utc();
     }
 
+    // Time zones compiled into the library need no loading.
+    if (is_default(opts)) {
+        tz = find_embedded(tz_desc);
+        if (tz != NULL) {
+            return tz;
+        }
+    }
+
     // If the description begins with a colon then treat it as a path.
     if (*tz_desc == ':') {
         const char *path = tz_desc + 1;
         if (*path == '/') {
-            errno = load_tz(&tz, path);
+            errno = load_tz(&tz, path, opts);
         } else {
-            errno = load_tz(&tz, mkpath(pathbuf, sizeof(pathbuf), path));
+            errno = load_tz(&tz, mkpath(pathbuf, sizeof(pathbuf), path), opts);
         }
         return tz;
     }
@@ -1127,9 +1465,9 @@ struct tz64 *tz64_alloc(const char *tz_desc)
     // No colon, but try reading as a path anyway.
     int res;
     if (*tz_desc == '/') {
-        res = load_tz(&tz, tz_desc);
+        res = load_tz(&tz, tz_desc, opts);
     } else {
-        res = load_tz(&tz, mkpath(pathbuf, sizeof(pathbuf), tz_desc));
+        res = load_tz(&tz, mkpath(pathbuf, sizeof(pathbuf), tz_desc), opts);
     }
     if (res != ENOENT) {
         errno = res;
@@ -1137,14 +1475,414 @@ struct tz64 *tz64_alloc(const char *tz_desc)
     }
 
     // Try using the string as a POSIX TZ expression.
-    return make_tz_from_string(tz_desc);
+    return make_tz_from_string(tz_desc, opts);
+}
+
+
+struct tz64 *tz64_alloc_from_memory(const void *data, size_t size, const struct tz64_options *opts)
+{
+    // NULL options mean the defaults.
+    struct tz64_options defaults;
+    if (opts == NULL) {
+        tz64_options_init(&defaults);
+        opts = &defaults;
+    }
+
+    if (data == NULL || size > INT64_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // The time zone is decoded into a block of its own, or keeps a
+    // copy of the data until it is, so nothing refers to the data
+    // afterwards.
+    return decode_tzfile(NULL, data, size, opts);
+}
+
+
+int tz_load_lazy(const struct tz64 *tz)
+{
+    // The decoded time zone's header is copied over this one's, and
+    // published by clearing pending.  Lookups don't read the header
+    // until they see pending clear.
+    struct tz64 *handle = (struct tz64 *)tz;
+    struct tz_lazy *lazy = handle->lazy;
+    pthread_mutex_lock(&lazy_lock);
+    int error = lazy->error;
+    if (lazy->block == NULL && error == 0) {
+        struct tz64 *block = process_tzfile(NULL, lazy->data, lazy->size, &lazy->opts);
+        if (block == NULL) {
+            // Running out of memory is worth trying again.
+            error = (errno == ENOMEM) ? ENOMEM : EINVAL;
+            lazy->error = (error == ENOMEM) ? 0 : error;
+        } else {
+            lazy->block = block;
+            memcpy(handle, block, offsetof(struct tz64, size));
+            free(lazy->data);
+            lazy->data = NULL;
+            __atomic_store_n(&handle->pending, 0, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&lazy_lock);
+
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
 }
 
 
 void tz64_free(struct tz64 *tz)
 {
+    // Time zones compiled into the library aren't on the heap.
+    if (tz == NULL || tz->size == 0) {
+        return;
+    }
+
+    if (tz->lazy != NULL) {
+        free(tz->lazy->block);
+        free(tz->lazy->data);
+    }
+
     free(tz);
 }
 
+
+// The registry is a hash table of time zones keyed by description.
+// Lookups walk the chains without locking, so entries are only ever
+// unlinked while registry_lock is held, and are freed only once no
+// lookup that might have seen them is still in progress.  Several
+// descriptions of the same file share one time zone, owned by the
+// first entry made for it.
+struct registry_entry {
+    struct registry_entry *next;
+    struct registry_entry *retired;
+    struct registry_entry *owner;
+    struct tz64 *tz;
+    uint64_t hash;
+    uint64_t last_used;
+    dev_t dev;
+    ino_t ino;
+    bool local;
+    char desc[];
+};
+
+static struct registry_entry *registry[REGISTRY_BUCKETS];
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The number of lookups in progress, the entries waiting for there to
+// be none, and the total size of the time zones in the registry,
+// including those evicted but not yet freed, and the limit on it.
+// Everything but the count of lookups is protected by registry_lock.
+static uint32_t registry_readers;
+static struct registry_entry *registry_retired;
+static size_t registry_size;
+static size_t registry_limit;
+
+// Advanced by each insertion, and recorded by each lookup, so that
+// the least recently used time zones can be told apart roughly.
+static uint64_t registry_clock;
+
+
+// Hash a description with FNV-1a.  NULL, meaning local time, hashes
+// differently from the empty string, meaning UTC.
+static uint64_t hash_desc(const char *desc, bool local)
+{
+    uint64_t hash = local ? UINT64_C(0x84222325cbf29ce4) : UINT64_C(0xcbf29ce484222325);
+    for (const char *p = desc; *p != '\0'; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= UINT64_C(0x100000001b3);
+    }
+
+    return hash;
+}
+
+
+// Identify the file tz64_alloc would first try to load for a
+// description.  Returns false if there's no such file, or if the
+// description is NULL and could come from either of two files.
+static bool identify_desc(const char *tz_desc, dev_t *dev, ino_t *ino)
+{
+    char pathbuf[256];
+    const char *path;
+    if (tz_desc == NULL) {
+        return false;
+    } else if (*tz_desc == '\0') {
+        path = mkpath(pathbuf, sizeof(pathbuf), "UTC");
+    } else {
+        path = (*tz_desc == ':') ? tz_desc + 1 : tz_desc;
+        if (*path != '/') {
+            path = mkpath(pathbuf, sizeof(pathbuf), path);
+        }
+    }
+
+    struct stat statbuf;
+    if (path == NULL || stat(path, &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+        return false;
+    }
+
+    *dev = statbuf.st_dev;
+    *ino = statbuf.st_ino;
+    return true;
+}
+
+
+// Take a reference to a time zone unless it's been evicted.
+static bool take_ref(struct tz64 *tz)
+{
+    uint32_t refs = __atomic_load_n(&tz->refs, __ATOMIC_RELAXED);
+    do {
+        if (refs == REFS_DEAD) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&tz->refs, &refs, refs + 1, true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    return true;
+}
+
+
+// Find the entry for a description and take a reference to its time
+// zone.  Returns NULL if there's no such entry.
+static struct tz64 *registry_find(uint64_t hash, const char *desc, bool local)
+{
+    __atomic_add_fetch(&registry_readers, 1, __ATOMIC_SEQ_CST);
+
+    struct tz64 *tz = NULL;
+    struct registry_entry *entry = __atomic_load_n(&registry[hash % REGISTRY_BUCKETS], __ATOMIC_SEQ_CST);
+    while (entry != NULL) {
+        if (entry->hash == hash && entry->local == local && strcmp(entry->desc, desc) == 0) {
+            if (take_ref(entry->tz)) {
+                // Only write the time of use when it changes, so that
+                // busy time zones' entries stay shared in caches.
+                struct registry_entry *owner = entry->owner;
+                const uint64_t now = __atomic_load_n(&registry_clock, __ATOMIC_RELAXED);
+                if (__atomic_load_n(&owner->last_used, __ATOMIC_RELAXED) != now) {
+                    __atomic_store_n(&owner->last_used, now, __ATOMIC_RELAXED);
+                }
+                tz = entry->tz;
+            }
+            break;
+        }
+
+        entry = __atomic_load_n(&entry->next, __ATOMIC_SEQ_CST);
+    }
+
+    __atomic_sub_fetch(&registry_readers, 1, __ATOMIC_SEQ_CST);
+    return tz;
+}
+
+
+// Unlink every entry for a time zone and set them aside to be freed.
+// The caller must hold registry_lock.
+static void registry_unlink(const struct tz64 *tz)
+{
+    for (size_t i = 0; i < REGISTRY_BUCKETS; i++) {
+        struct registry_entry **prev = &registry[i];
+        while (*prev != NULL) {
+            struct registry_entry *entry = *prev;
+            if (entry->tz == tz) {
+                __atomic_store_n(prev, entry->next, __ATOMIC_SEQ_CST);
+                entry->retired = registry_retired;
+                registry_retired = entry;
+            } else {
+                prev = &entry->next;
+            }
+        }
+    }
+}
+
+
+// Free the time zones evicted so far if no lookups are in progress,
+// since any lookup might still be looking at them.  The caller must
+// hold registry_lock.
+static void registry_reclaim(void)
+{
+    if (registry_retired == NULL || __atomic_load_n(&registry_readers, __ATOMIC_SEQ_CST) != 0) {
+        return;
+    }
+
+    while (registry_retired != NULL) {
+        struct registry_entry *entry = registry_retired;
+        registry_retired = entry->retired;
+        if (entry->owner == entry) {
+            registry_size -= entry->tz->size;
+            tz64_free(entry->tz);
+        }
+        free(entry);
+    }
+}
+
+
+// Evict the least recently used time zones that nobody holds until
+// the registry fits within its limit, and free what was evicted if no
+// lookups are in progress.  The caller must hold registry_lock.
+static void registry_trim(void)
+{
+    while (registry_limit != 0 && registry_size > registry_limit) {
+        // Lookups update the times of use without the lock.
+        struct registry_entry *victim = NULL;
+        uint64_t victim_used = 0;
+        for (size_t i = 0; i < REGISTRY_BUCKETS; i++) {
+            for (struct registry_entry *entry = registry[i]; entry != NULL; entry = entry->next) {
+                if (entry->owner != entry || __atomic_load_n(&entry->tz->refs, __ATOMIC_RELAXED) != 0) {
+                    continue;
+                }
+
+                const uint64_t used = __atomic_load_n(&entry->last_used, __ATOMIC_RELAXED);
+                if (victim == NULL || used < victim_used) {
+                    victim = entry;
+                    victim_used = used;
+                }
+            }
+        }
+
+        if (victim == NULL) {
+            break;
+        }
+
+        // A lookup may have taken a reference since; if so, look
+        // again.
+        uint32_t refs = 0;
+        if (__atomic_compare_exchange_n(&victim->tz->refs, &refs, REFS_DEAD, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            registry_unlink(victim->tz);
+        }
+
+        // Evicted time zones count until they're freed.
+        registry_reclaim();
+    }
+
+    registry_reclaim();
+}
+
+
+// Add an entry for a freshly loaded time zone, unless another thread
+// has got there first or the same file is already loaded, in which
+// case use that instead.  Returns the time zone with a reference.
+static struct tz64 *registry_insert(uint64_t hash, const char *desc, bool local,
+                                    bool identified, dev_t dev, ino_t ino, struct tz64 *tz)
+{
+    const size_t len = strlen(desc);
+    struct registry_entry *entry = calloc(1, sizeof(struct registry_entry) + len + 1);
+    if (entry == NULL) {
+        tz64_free(tz);
+        return NULL;
+    }
+
+    entry->owner = entry;
+    entry->tz = tz;
+    entry->hash = hash;
+    entry->dev = dev;
+    entry->ino = ino;
+    entry->local = local;
+    memcpy(entry->desc, desc, len + 1);
+
+    pthread_mutex_lock(&registry_lock);
+
+    // Look for the description and the file among the live entries.
+    // Nothing can be evicted while the lock is held.
+    struct registry_entry **head = &registry[hash % REGISTRY_BUCKETS];
+    struct registry_entry *found = NULL;
+    for (struct registry_entry *other = *head; other != NULL; other = other->next) {
+        if (other->hash == hash && other->local == local && strcmp(other->desc, desc) == 0) {
+            found = other;
+            break;
+        }
+    }
+
+    for (size_t i = 0; found == NULL && identified && i < REGISTRY_BUCKETS; i++) {
+        for (struct registry_entry *other = registry[i]; other != NULL; other = other->next) {
+            if (other->owner == other && other->dev == dev && other->ino == ino) {
+                entry->owner = other;
+                entry->tz = other->tz;
+                break;
+            }
+        }
+    }
+
+    if (found != NULL) {
+        (void)take_ref(found->tz);
+        pthread_mutex_unlock(&registry_lock);
+        tz64_free(tz);
+        free(entry);
+        return found->tz;
+    }
+
+    // The new entry owns its time zone or shares another's.
+    if (entry->owner == entry) {
+        registry_size += tz->size;
+    } else {
+        tz64_free(tz);
+    }
+
+    tz = entry->tz;
+    (void)take_ref(tz);
+    entry->last_used = __atomic_add_fetch(&registry_clock, 1, __ATOMIC_RELAXED);
+    entry->next = *head;
+    __atomic_store_n(head, entry, __ATOMIC_SEQ_CST);
+
+    registry_trim();
+    pthread_mutex_unlock(&registry_lock);
+    return tz;
+}
+
+
+const struct tz64 *tz64_acquire(const char *tz_desc)
+{
+    const bool local = tz_desc == NULL;
+    const char *desc = local ? "" : tz_desc;
+    const uint64_t hash = hash_desc(desc, local);
+
+    // Time zones compiled into the library live as long as it does,
+    // so they needn't be counted.
+    struct tz64 *tz = local ? NULL : find_embedded(desc);
+    if (tz != NULL) {
+        return tz;
+    }
+
+    tz = registry_find(hash, desc, local);
+    if (tz != NULL) {
+        return tz;
+    }
+
+    // Lookups that find what they want never free evicted time zones,
+    // so take the chance to here.
+    pthread_mutex_lock(&registry_lock);
+    registry_reclaim();
+    pthread_mutex_unlock(&registry_lock);
+
+    // Load it without holding the lock.  If another thread loads it
+    // at the same time then one copy is thrown away.
+    dev_t dev = 0;
+    ino_t ino = 0;
+    const bool identified = identify_desc(tz_desc, &dev, &ino);
+    tz = tz64_alloc(tz_desc);
+    if (tz == NULL) {
+        return NULL;
+    }
+
+    return registry_insert(hash, desc, local, identified, dev, ino, tz);
+}
+
+
+void tz64_release(const struct tz64 *tz)
+{
+    if (tz != NULL && tz->size != 0) {
+        __atomic_sub_fetch(&((struct tz64 *)tz)->refs, 1, __ATOMIC_RELEASE);
+    }
+}
+
+
+void tz64_registry_set_limit(size_t limit)
+{
+    pthread_mutex_lock(&registry_lock);
+    registry_limit = limit;
+    registry_trim();
+    pthread_mutex_unlock(&registry_lock);
+}
+
 ////////////////////////////////////////////////////////////////////////
 // End of tz64file.c
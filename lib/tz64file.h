@@ -23,6 +23,7 @@
 #define TZ64FILE_H 1
 
 #include <inttypes.h>
+#include "tz64.h"
 
 // The format of a TZif file header.
 struct tz_header {
@@ -38,6 +39,28 @@ struct tz_header {
 };
 
 
+// The header of a bundle of time zones compiled by tzbundle.  The
+// bundle holds each time zone's block as tz64_alloc lays it out in
+// memory, in the byte order of the host that wrote it, with the
+// pointers in the struct tz64 at the start of the block replaced by
+// offsets from the start of the block.  The blocks are followed by an
+// index of names, sorted by strcmp, and then the names themselves.
+struct tz_bundle_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t struct_size;
+    uint32_t name_count;
+    uint64_t index_offset;
+    uint64_t size;
+};
+
+struct tz_bundle_index {
+    uint64_t name_offset;
+    uint64_t block_offset;
+};
+
+
 struct tz_offset {
     int32_t utoff:23;
     uint32_t isdst:1;
@@ -45,10 +68,36 @@ struct tz_offset {
 };
 
 
+// A sorted array of timestamps laid out in Eytzinger (breadth-first)
+// order, so that the first few levels of a search share cache lines.
+// The values are 1-based; rank gives each value's index in the sorted
+// array, and rank[0] is the length of that array.
+struct tz_eytzinger {
+    const int64_t *values;
+    const uint32_t *rank;
+};
+
+
+// A direct index of the transitions between begin and end, with one
+// bucket per 2^shift seconds.  Each bucket of fwd holds the index of
+// the latest transition no later than the start of the bucket, and
+// each bucket of rev holds the index of the latest local-time edge no
+// later than the start of the bucket.
+struct tz_bucket_index {
+    int64_t begin;
+    int64_t end;
+    uint32_t count;
+    uint32_t shift;
+    const uint16_t *fwd;
+    const uint16_t *rev;
+};
+
+
 struct tz64 {
     uint32_t ts_count;
     uint32_t leap_count;
     const int64_t *timestamps;
+    const int64_t *local_edges;
     const uint8_t *offset_map;
     const struct tz_offset *offsets;
     const int64_t *leap_ts;
@@ -56,9 +105,51 @@ struct tz64 {
     const int32_t *leap_secs;
     const char *desig;
     const int32_t *extra_ts;
+    const int32_t *extra_cycle;
+    struct tz_eytzinger ts_eytz;
+    struct tz_eytzinger leap_eytz;
+    struct tz_eytzinger rev_leap_eytz;
+    struct tz_bucket_index buckets;
+
+    // The size of the block holding the time zone, or zero if it
+    // isn't on the heap, and the number of references to it handed
+    // out by the registry.
+    size_t size;
+    uint32_t refs;
+
+    // Nonzero until a lazily loaded time zone has been decoded, when
+    // everything above is copied from the decoded block.
+    uint32_t pending;
+    struct tz_lazy *lazy;
+};
+
+
+// The data of a lazily loaded time zone, and the time zone decoded
+// from it on first use.
+struct tz_lazy {
+    struct tz64 *block;
+    char *data;
+    size_t size;
+    int error;
+    struct tz64_options opts;
 };
 
 
+// Decode a lazily loaded time zone, if that hasn't been done already.
+// Returns -1 and sets errno if it can't be decoded.
+int tz_load_lazy(const struct tz64 *tz);
+
+
+// The time zones compiled into the library, sorted by name.
+struct tz_embedded {
+    const char *name;
+    const struct tz64 *tz;
+};
+
+extern const struct tz_embedded tz_embedded_zones[];
+extern const size_t tz_embedded_count;
+
+
 void tz_header_fix_endian(struct tz_header *header);
 size_t tz_header_data_len(const struct tz_header *header, size_t time_size);
 
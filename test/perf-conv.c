@@ -13,9 +13,20 @@ enum mode {
     MODE_TZ64_TS_TO_TM,
     MODE_LOCALTIME_R,
     MODE_GMTIME_R,
-    MODE_LOCALTIME_RZ
+    MODE_LOCALTIME_RZ,
+    MODE_TZ64_BATCH,
+    MODE_TZ64_SEARCH,
+    MODE_TZ64_MIXED
 };
 
+#define BATCH_SIZE 4096
+
+// The number of separately loaded copies of the time zone, and the
+// number of rows spread across them, used to measure conversions
+// where each row has its own zone.
+#define MIXED_ZONES 1024
+#define MIXED_ROWS 65536
+
 static const char *progname;
 
 static void set_progname(const char *arg0)
@@ -27,13 +38,524 @@ static void set_progname(const char *arg0)
 
 static void usage()
 {
-    fprintf(stderr, "usage: %s [-c] [-u] [-s timestamp] [-t tz] [-n cycles]\n", progname);
+    fprintf(stderr, "usage: %s [-b] [-c] [-e] [-m] [-r] [-u] [-s timestamp] [-t tz] [-n cycles]\n", progname);
     fprintf(stderr, "    -s timestamp    Use timestamp when converting to localtime [now]\n");
     fprintf(stderr, "    -t tz           Perform tests in tz\n");
     fprintf(stderr, "    -n cycles       Run each test cycles times [100,000,000]\n");
-    fprintf(stderr, "    -u              Mesaure UTC (gmtime/timegm) performance\n");
+    fprintf(stderr, "    -u              Measure UTC (gmtime_r/timegm against tz64_gmtime/tz64_timegm) performance\n");
     fprintf(stderr, "    -c              Measure libc's mktime/localtime_r performance\n");
     fprintf(stderr, "    -z              Measure libtz (localtime_rz/mktime_z) performance\n");
+    fprintf(stderr, "    -b              Measure batch, columnar, compact, sorted and offset-only conversion performance\n");
+    fprintf(stderr, "    -e              Measure transition search performance on historical timestamps\n");
+    fprintf(stderr, "    -m              Measure conversion performance with each timestamp in its own zone\n");
+    fprintf(stderr, "    -r              Expand the time zone's daylight saving rules when loading it\n");
+}
+
+
+// Scatter timestamps across [begin, end).
+static void fill_range(int64_t *ts, size_t count, int64_t begin, int64_t end)
+{
+    uint64_t x = 88172645463325252ull;
+    for (size_t i = 0; i < count; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        ts[i] = begin + (int64_t)(x % (uint64_t)(end - begin));
+    }
+}
+
+
+// Scatter timestamps across the 20 years either side of when so that
+// each conversion has its own transition to find.
+static void fill_timestamps(int64_t *ts, size_t count, time_t when)
+{
+    const int64_t span = INT64_C(20) * 365 * 86400;
+    fill_range(ts, count, when - span, when + span);
+}
+
+
+static int compare_ts(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+
+static void report(const char *name, clock_t before, clock_t after, unsigned long count, int sum)
+{
+    printf("%s: %g ns/element (%d)\n", name, (double)(after - before) / CLOCKS_PER_SEC * 1e9 / count, sum);
+}
+
+
+static void measure_batch(const struct tz64 *tz, time_t when, unsigned long cycles)
+{
+    static int64_t ts[BATCH_SIZE];
+    static struct tm tm[BATCH_SIZE];
+    fill_timestamps(ts, BATCH_SIZE, when);
+
+    unsigned long rounds = (cycles + BATCH_SIZE - 1) / BATCH_SIZE;
+    unsigned long count = rounds * BATCH_SIZE;
+
+    // Convert one at a time for comparison.
+    int sum = 0;
+    clock_t before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_ts_to_tm(tz, ts[j], &tm[j]);
+        }
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    clock_t after = clock();
+    report("tz64_ts_to_tm", before, after, count, sum);
+
+    // And then all at once.
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ts_to_tm_batch(tz, ts, tm, BATCH_SIZE);
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    after = clock();
+    report("tz64_ts_to_tm_batch", before, after, count, sum);
+
+    // And into columns.
+    static int32_t year[BATCH_SIZE];
+    static int8_t mon[BATCH_SIZE], mday[BATCH_SIZE], hour[BATCH_SIZE], min[BATCH_SIZE], sec[BATCH_SIZE];
+    static int32_t utoff[BATCH_SIZE];
+    struct tz64_columns cols = {
+        .year = year, .mon = mon, .mday = mday,
+        .hour = hour, .min = min, .sec = sec,
+        .utoff = utoff
+    };
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ts_to_columns(tz, ts, &cols, BATCH_SIZE);
+        sum += hour[i % BATCH_SIZE];
+    }
+    after = clock();
+    report("tz64_ts_to_columns", before, after, count, sum);
+
+    // And back from columns, comparing with one at a time.
+    static int64_t back[BATCH_SIZE];
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            struct tm tmp;
+            memset(&tmp, 0, sizeof(tmp));
+            tmp.tm_year = year[j] - 1900;
+            tmp.tm_mon = mon[j] - 1;
+            tmp.tm_mday = mday[j];
+            tmp.tm_hour = hour[j];
+            tmp.tm_min = min[j];
+            tmp.tm_sec = sec[j];
+            tmp.tm_isdst = -1;
+            back[j] = tz64_tm_to_ts(tz, &tmp);
+        }
+        sum += back[i % BATCH_SIZE] % 86400 / 3600;
+    }
+    after = clock();
+    report("tz64_tm_to_ts", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_columns_to_ts(tz, &cols, back, BATCH_SIZE);
+        sum += back[i % BATCH_SIZE] % 86400 / 3600;
+    }
+    after = clock();
+    report("tz64_columns_to_ts", before, after, count, sum);
+
+    // And from nanoseconds.
+    static int64_t ns[BATCH_SIZE];
+    static int32_t nsec[BATCH_SIZE];
+    for (size_t j = 0; j < BATCH_SIZE; j++) {
+        ns[j] = ts[j] * 1000000000 + (int64_t)j * 7919;
+    }
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_ns_to_tm(tz, ns[j], &tm[j], &nsec[j]);
+        }
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    after = clock();
+    report("tz64_ns_to_tm", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ns_to_tm_batch(tz, ns, tm, nsec, BATCH_SIZE);
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    after = clock();
+    report("tz64_ns_to_tm_batch", before, after, count, sum);
+
+    // Convert to compact broken-down time, in full and just the time
+    // of day.
+    static struct tz64_fields fields[BATCH_SIZE];
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_ts_to_fields(tz, ts[j], &fields[j], TZ64_FIELDS_ALL);
+        }
+        sum += fields[i % BATCH_SIZE].hour;
+    }
+    after = clock();
+    report("tz64_ts_to_fields", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_ts_to_fields(tz, ts[j], &fields[j], TZ64_FIELD_TIME);
+        }
+        sum += fields[i % BATCH_SIZE].hour;
+    }
+    after = clock();
+    report("tz64_ts_to_fields (time)", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ts_to_fields_batch(tz, ts, fields, BATCH_SIZE, TZ64_FIELDS_ALL);
+        sum += fields[i % BATCH_SIZE].hour;
+    }
+    after = clock();
+    report("tz64_ts_to_fields_batch", before, after, count, sum);
+
+    // Convert those fields to another zone, the long way round and
+    // directly.
+    struct tz64 *other = tz64_alloc("America/Chicago");
+    if (other != NULL) {
+        static struct tz64_fields out[BATCH_SIZE];
+        sum = 0;
+        before = clock();
+        for (unsigned long i = 0; i < rounds; i++) {
+            for (size_t j = 0; j < BATCH_SIZE; j++) {
+                (void)tz64_ts_to_fields(other, tz64_fields_to_ts(tz, &fields[j], TZ64_FIELDS_ALL),
+                                        &out[j], TZ64_FIELDS_ALL);
+            }
+            sum += out[i % BATCH_SIZE].hour;
+        }
+        after = clock();
+        report("tz64_fields_to_ts + tz64_ts_to_fields", before, after, count, sum);
+
+        sum = 0;
+        before = clock();
+        for (unsigned long i = 0; i < rounds; i++) {
+            for (size_t j = 0; j < BATCH_SIZE; j++) {
+                (void)tz64_convert(tz, other, &fields[j], &out[j], TZ64_FIELDS_ALL);
+            }
+            sum += out[i % BATCH_SIZE].hour;
+        }
+        after = clock();
+        report("tz64_convert", before, after, count, sum);
+
+        sum = 0;
+        before = clock();
+        for (unsigned long i = 0; i < rounds; i++) {
+            (void)tz64_convert_batch(tz, other, fields, out, BATCH_SIZE, TZ64_FIELDS_ALL);
+            sum += out[i % BATCH_SIZE].hour;
+        }
+        after = clock();
+        report("tz64_convert_batch", before, after, count, sum);
+        tz64_free(other);
+    }
+
+    // Look up just the offsets, and just the local seconds.
+    static struct tz64_offset_info info[BATCH_SIZE];
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_offset_at(tz, ts[j], &info[j]);
+        }
+        sum += info[i % BATCH_SIZE].isdst;
+    }
+    after = clock();
+    report("tz64_offset_at", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_offset_at_batch(tz, ts, info, BATCH_SIZE);
+        sum += info[i % BATCH_SIZE].isdst;
+    }
+    after = clock();
+    report("tz64_offset_at_batch", before, after, count, sum);
+
+    static int64_t local[BATCH_SIZE];
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            local[j] = tz64_ts_to_local(tz, ts[j]);
+        }
+        sum += local[i % BATCH_SIZE] % 86400 / 3600;
+    }
+    after = clock();
+    report("tz64_ts_to_local", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ts_to_local_batch(tz, ts, local, BATCH_SIZE);
+        sum += local[i % BATCH_SIZE] % 86400 / 3600;
+    }
+    after = clock();
+    report("tz64_ts_to_local_batch", before, after, count, sum);
+
+    // Walk a grid of one timestamp per minute, converting each afresh
+    // and then by stepping from the last.
+    struct tm step_tm;
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < count; i++) {
+        (void)tz64_ts_to_tm(tz, when + (int64_t)i * 60, &step_tm);
+        sum += step_tm.tm_hour;
+    }
+    after = clock();
+    report("tz64_ts_to_tm (grid)", before, after, count, sum);
+
+    sum = 0;
+    (void)tz64_ts_to_tm(tz, when, &step_tm);
+    before = clock();
+    for (unsigned long i = 1; i < count; i++) {
+        (void)tz64_tm_advance(tz, &step_tm, when + (int64_t)(i - 1) * 60, when + (int64_t)i * 60);
+        sum += step_tm.tm_hour;
+    }
+    after = clock();
+    report("tz64_tm_advance (grid)", before, after, count, sum);
+
+    // Compare the sorted variant on random and sorted input.
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ts_to_tm_sorted(tz, ts, tm, BATCH_SIZE);
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    after = clock();
+    report("tz64_ts_to_tm_sorted (random)", before, after, count, sum);
+
+    qsort(ts, BATCH_SIZE, sizeof(ts[0]), compare_ts);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ts_to_tm_batch(tz, ts, tm, BATCH_SIZE);
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    after = clock();
+    report("tz64_ts_to_tm_batch (sorted)", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ts_to_tm_sorted(tz, ts, tm, BATCH_SIZE);
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    after = clock();
+    report("tz64_ts_to_tm_sorted (sorted)", before, after, count, sum);
+}
+
+
+// Compare the Eytzinger layout of the transition table and the bucket
+// index against a plain binary search over timestamps from 1900 until
+// when.
+static void measure_search(const struct tz64 *tz, time_t when, unsigned long cycles)
+{
+    static int64_t ts[BATCH_SIZE];
+    static struct tm tm;
+    fill_range(ts, BATCH_SIZE, INT64_C(-2208988800), when);
+
+    // Make copies of the time zone without the bucket index, and
+    // without the Eytzinger layouts either.
+    struct tz64 eytz = *tz;
+    memset(&eytz.buckets, 0, sizeof(eytz.buckets));
+
+    struct tz64 plain = eytz;
+    memset(&plain.ts_eytz, 0, sizeof(plain.ts_eytz));
+    memset(&plain.leap_eytz, 0, sizeof(plain.leap_eytz));
+    memset(&plain.rev_leap_eytz, 0, sizeof(plain.rev_leap_eytz));
+
+    unsigned long rounds = (cycles + BATCH_SIZE - 1) / BATCH_SIZE;
+    unsigned long count = rounds * BATCH_SIZE;
+
+    int sum = 0;
+    clock_t before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_ts_to_tm(&plain, ts[j], &tm);
+            sum += tm.tm_hour;
+        }
+    }
+    clock_t after = clock();
+    report("binary search", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_ts_to_tm(&eytz, ts[j], &tm);
+            sum += tm.tm_hour;
+        }
+    }
+    after = clock();
+    report("eytzinger", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_ts_to_tm(tz, ts[j], &tm);
+            sum += tm.tm_hour;
+        }
+    }
+    after = clock();
+    report("bucket index", before, after, count, sum);
+}
+
+
+// Compare libc's gmtime_r and timegm with tz64's UTC functions, one
+// at a time and in batches.
+static void measure_utc(time_t when, unsigned long cycles)
+{
+    static int64_t ts[BATCH_SIZE];
+    static time_t t[BATCH_SIZE];
+    static struct tm tm[BATCH_SIZE];
+    fill_timestamps(ts, BATCH_SIZE, when);
+    for (size_t j = 0; j < BATCH_SIZE; j++) {
+        t[j] = ts[j];
+    }
+
+    unsigned long rounds = (cycles + BATCH_SIZE - 1) / BATCH_SIZE;
+    unsigned long count = rounds * BATCH_SIZE;
+
+    int sum = 0;
+    clock_t before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)gmtime_r(&t[j], &tm[j]);
+        }
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    clock_t after = clock();
+    report("gmtime_r", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            (void)tz64_gmtime(ts[j], &tm[j]);
+        }
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    after = clock();
+    report("tz64_gmtime", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_gmtime_batch(ts, tm, BATCH_SIZE);
+        sum += tm[i % BATCH_SIZE].tm_hour;
+    }
+    after = clock();
+    report("tz64_gmtime_batch", before, after, count, sum);
+
+    // And back.  The broken-down times are already canonical, so
+    // each round converts the same ones.
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            t[j] = timegm(&tm[j]);
+        }
+        sum += t[i % BATCH_SIZE];
+    }
+    after = clock();
+    report("timegm", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            ts[j] = tz64_timegm(&tm[j]);
+        }
+        sum += ts[i % BATCH_SIZE];
+    }
+    after = clock();
+    report("tz64_timegm", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_timegm_batch(tm, ts, BATCH_SIZE);
+        sum += ts[i % BATCH_SIZE];
+    }
+    after = clock();
+    report("tz64_timegm_batch", before, after, count, sum);
+}
+
+
+// Compare converting rows one at a time in their own zones against
+// tz64_ts_to_tm_mixed, with the rows spread over enough copies of the
+// time zone that their headers and tables don't all stay in cache.
+static void measure_mixed(const char *tz_name, const struct tz64_options *opts, time_t when,
+                          unsigned long cycles)
+{
+    static struct tz64 *copies[MIXED_ZONES];
+    for (size_t i = 0; i < MIXED_ZONES; i++) {
+        copies[i] = tz64_alloc_with(tz_name, opts);
+        if (copies[i] == NULL) {
+            fprintf(stderr, "%s: error: failed to load time zone %s: %s\n", progname, tz_name, strerror(errno));
+            exit(1);
+        }
+    }
+
+    static const struct tz64 *zones[MIXED_ROWS];
+    static int64_t ts[MIXED_ROWS];
+    static struct tm tm[MIXED_ROWS];
+    fill_timestamps(ts, MIXED_ROWS, when);
+    uint64_t x = 2463534242;
+    for (size_t j = 0; j < MIXED_ROWS; j++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        zones[j] = copies[x % MIXED_ZONES];
+    }
+
+    unsigned long rounds = (cycles + MIXED_ROWS - 1) / MIXED_ROWS;
+    unsigned long count = rounds * MIXED_ROWS;
+
+    int sum = 0;
+    clock_t before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        for (size_t j = 0; j < MIXED_ROWS; j++) {
+            (void)tz64_ts_to_tm(zones[j], ts[j], &tm[j]);
+        }
+        sum += tm[i % MIXED_ROWS].tm_hour;
+    }
+    clock_t after = clock();
+    report("tz64_ts_to_tm (mixed zones)", before, after, count, sum);
+
+    sum = 0;
+    before = clock();
+    for (unsigned long i = 0; i < rounds; i++) {
+        (void)tz64_ts_to_tm_mixed(zones, ts, tm, MIXED_ROWS);
+        sum += tm[i % MIXED_ROWS].tm_hour;
+    }
+    after = clock();
+    report("tz64_ts_to_tm_mixed", before, after, count, sum);
+
+    for (size_t i = 0; i < MIXED_ZONES; i++) {
+        tz64_free(copies[i]);
+    }
 }
 
 
@@ -43,17 +565,35 @@ int main(int argc, char *argv[])
     unsigned long cycles = 100e6;
     enum mode mode = MODE_TZ64_TS_TO_TM;
     time_t when = time(NULL);
+    struct tz64_options opts;
+    tz64_options_init(&opts);
 
     set_progname(argv[0]);
 
     char *p;
     int choice;
-    while ((choice = getopt(argc, argv, "cn:s:t:uz")) != -1) {
+    while ((choice = getopt(argc, argv, "bcemn:rs:t:uz")) != -1) {
         switch (choice) {
+        case 'b':
+            mode = MODE_TZ64_BATCH;
+            break;
+
         case 'c':
             mode = MODE_LOCALTIME_R;
             break;
 
+        case 'e':
+            mode = MODE_TZ64_SEARCH;
+            break;
+
+        case 'm':
+            mode = MODE_TZ64_MIXED;
+            break;
+
+        case 'r':
+            opts.expand_rules = 1;
+            break;
+
         case 't':
             tz_name = optarg;
             break;
@@ -91,10 +631,20 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (mode == MODE_TZ64_MIXED) {
+        measure_mixed(tz_name, &opts, when, cycles);
+        return 0;
+    }
+
+    if (mode == MODE_GMTIME_R) {
+        measure_utc(when, cycles);
+        return 0;
+    }
+
     // Load the time zone.
     struct tz64 *tz = NULL;
-    if (mode == MODE_TZ64_TS_TO_TM) {
-        tz = tz64_alloc(tz_name);
+    if (mode == MODE_TZ64_TS_TO_TM || mode == MODE_TZ64_BATCH || mode == MODE_TZ64_SEARCH) {
+        tz = tz64_alloc_with(tz_name, &opts);
         if (tz == NULL) {
             fprintf(stderr, "%s: error: failed to load time zone %s: %s\n", progname, tz_name, strerror(errno));
             exit(1);
@@ -113,7 +663,19 @@ int main(int argc, char *argv[])
         setenv("TZ", tz_name, 1);
         tzset();
     }
-    
+
+    if (mode == MODE_TZ64_BATCH) {
+        measure_batch(tz, when, cycles);
+        tz64_free(tz);
+        return 0;
+    }
+
+    if (mode == MODE_TZ64_SEARCH) {
+        measure_search(tz, when, cycles);
+        tz64_free(tz);
+        return 0;
+    }
+
     int sum = 0;
     clock_t before = clock();
     for (unsigned long i = 0; i < cycles; i++) {
@@ -123,6 +685,9 @@ int main(int argc, char *argv[])
         struct tm tm;
         switch (mode) {
         case MODE_TZ64_TS_TO_TM:
+        case MODE_TZ64_BATCH:
+        case MODE_TZ64_SEARCH:
+        case MODE_TZ64_MIXED:
             (void)tz64_ts_to_tm(tz, when, &tm);
             break;
         case MODE_LOCALTIME_R:
@@ -149,6 +714,9 @@ int main(int argc, char *argv[])
     for (unsigned long i = 0; i < cycles; i++) {
         switch (mode) {
         case MODE_TZ64_TS_TO_TM:
+        case MODE_TZ64_BATCH:
+        case MODE_TZ64_SEARCH:
+        case MODE_TZ64_MIXED:
             sum += tz64_tm_to_ts(tz, &tm);
             break;
         case MODE_LOCALTIME_R:
@@ -166,6 +734,20 @@ int main(int argc, char *argv[])
 
     printf("%g (%d)\n", (double)(after - before) / CLOCKS_PER_SEC, sum);
 
+    // And from compact broken-down time.
+    if (mode == MODE_TZ64_TS_TO_TM) {
+        struct tz64_fields fields;
+        (void)tz64_ts_to_fields(tz, when, &fields, TZ64_FIELDS_ALL);
+
+        before = clock();
+        for (unsigned long i = 0; i < cycles; i++) {
+            sum += tz64_fields_to_ts(tz, &fields, TZ64_FIELDS_ALL);
+        }
+        after = clock();
+
+        printf("%g (%d)\n", (double)(after - before) / CLOCKS_PER_SEC, sum);
+    }
+
     tz64_free(tz);
     return 0;
 }
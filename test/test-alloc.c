@@ -0,0 +1,182 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <tz64.h>
+#include <tz64file.h>
+#include "utils.h"
+
+#define COUNT 4099
+
+static int64_t timestamps[COUNT];
+static struct tm expected[COUNT];
+static struct tm actual[COUNT];
+
+
+// Check that a time zone decoded from memory matches the one loaded
+// from the same file.
+static void check_memory(const char *name)
+{
+    size_t size;
+    char *data = read_zone_file(name, &size);
+    char *copy = malloc(size);
+    assert(copy != NULL);
+    memcpy(copy, data, size);
+    struct tz64 *tz = tz64_alloc_from_memory(copy, size, NULL);
+    assert(tz != NULL);
+
+    // The time zone doesn't need the data any more.
+    memset(copy, 0, size);
+    free(copy);
+    struct tz64 *file_tz = load_reference(name, timestamps, expected, COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        assert(tz64_ts_to_tm(tz, timestamps[i], &tm) == &tm);
+        assert_tm_eq(timestamps[i], &expected[i], &tm);
+    }
+
+    tz64_free(tz);
+    tz64_free(file_tz);
+
+    // Truncated or damaged data is rejected, except that the footer
+    // is optional.
+    const char *footer = data + size - 2;
+    while (*footer != '\n') {
+        footer--;
+    }
+
+    for (size_t len = 0; len < size; len++) {
+        if (data + len == footer) {
+            continue;
+        }
+
+        errno = 0;
+        assert(tz64_alloc_from_memory(data, len, NULL) == NULL);
+        assert(errno == EINVAL);
+    }
+
+    data[0] = 'X';
+    errno = 0;
+    assert(tz64_alloc_from_memory(data, size, NULL) == NULL);
+    assert(errno == EINVAL);
+    free(data);
+}
+
+
+// Convert the timestamps with a time zone that may not have been
+// decoded yet, and check the results.
+static void *use_lazy(void *arg)
+{
+    const struct tz64 *tz = arg;
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        assert(tz64_ts_to_tm(tz, timestamps[i], &tm) == &tm);
+        assert_tm_eq(timestamps[i], &expected[i], &tm);
+    }
+
+    return NULL;
+}
+
+
+// Check that lazily loaded time zones behave like the others once
+// they're used, even if several threads use them first at once, and
+// that they fail cleanly if the data turns out to be bad.
+static void check_lazy(const char *name)
+{
+    struct tz64_options opts;
+    tz64_options_init(&opts);
+    opts.lazy = 1;
+
+    struct tz64 *file_tz = load_reference(name, timestamps, expected, COUNT);
+    struct tz64 *tz = tz64_alloc_with(name, &opts);
+    assert(tz != NULL);
+    pthread_t threads[4];
+    for (size_t i = 0; i < 4; i++) {
+        assert(pthread_create(&threads[i], NULL, use_lazy, tz) == 0);
+    }
+
+    for (size_t i = 0; i < 4; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    // The batch and reverse conversions see the decoded time zone too.
+    struct tz64 *tz2 = tz64_alloc_with(name, &opts);
+    assert(tz2 != NULL);
+    memset(actual, 0, sizeof(actual));
+    assert(tz64_ts_to_tm_batch(tz2, timestamps, actual, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        assert_tm_eq(timestamps[i], &expected[i], &actual[i]);
+        actual[i].tm_isdst = -1;
+        expected[i].tm_isdst = -1;
+        assert(tz64_tm_to_ts(tz, &actual[i]) == tz64_tm_to_ts(file_tz, &expected[i]));
+    }
+
+    tz64_free(tz2);
+    tz64_free(tz);
+    tz64_free(file_tz);
+
+    // Damage the footer of the file, which only decoding notices.
+    size_t size;
+    char *data = read_zone_file(name, &size);
+    assert(data[size - 1] == '\n');
+    data[size - 1] = 'X';
+
+    assert(tz64_alloc_from_memory(data, size, NULL) == NULL);
+    tz = tz64_alloc_from_memory(data, size, &opts);
+    assert(tz != NULL);
+
+    struct tm tm;
+    errno = 0;
+    assert(tz64_ts_to_tm(tz, 0, &tm) == NULL);
+    assert(errno == EINVAL);
+    errno = 0;
+    assert(tz64_tm_to_ts(tz, &tm) == -1);
+    assert(errno == EINVAL);
+
+    const struct tz64 *zones[2] = { tz64_alloc("UTC"), tz };
+    errno = 0;
+    assert(tz64_ts_to_tm_mixed(zones, timestamps, actual, 2) == 1);
+    assert(errno == EINVAL);
+
+    tz64_free((struct tz64 *)zones[0]);
+    tz64_free(tz);
+    free(data);
+}
+
+
+int main(int argc, char *argv[])
+{
+    check_memory("America/New_York");
+    check_memory("right/Europe/London");
+    check_lazy("America/New_York");
+    check_lazy("right/Europe/London");
+
+    return 0;
+}
@@ -0,0 +1,674 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <tz64.h>
+#include <tz64file.h>
+#include "utils.h"
+
+#define COUNT 4099
+
+static const char *tz_names[] = {
+    "America/New_York",
+    "Australia/Melbourne",
+    "Asia/Hong_Kong",
+    "Europe/London",
+    "right/Europe/London",
+    "EST5EDT,M3.2.0,M11.1.0",
+    "HKT-8",
+    "UTC",
+    NULL
+};
+
+static int64_t timestamps[COUNT];
+static int64_t sorted[COUNT];
+static struct tm expected[COUNT];
+static struct tm actual[COUNT];
+
+static int32_t year[COUNT];
+static int8_t mon[COUNT];
+static int8_t mday[COUNT];
+static int8_t hour[COUNT];
+static int8_t min[COUNT];
+static int8_t sec[COUNT];
+static int16_t yday[COUNT];
+static int8_t wday[COUNT];
+static int32_t utoff[COUNT];
+static int8_t isdst[COUNT];
+static struct tz64_offset_info infos[COUNT];
+static int64_t locals[COUNT];
+static struct tz64_fields fields[COUNT];
+static int64_t units[COUNT];
+static int32_t fracs[COUNT];
+
+
+static int compare_ts(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+
+// Check conversions using cursors in both directions.
+static void check_cursor(const struct tz64 *tz)
+{
+    // The sorted batch should agree in any order, sorted or not.
+    memset(actual, 0, sizeof(actual));
+    assert(tz64_ts_to_tm_sorted(tz, timestamps, actual, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        assert_tm_eq(timestamps[i], &expected[i], &actual[i]);
+    }
+
+    memcpy(sorted, timestamps, sizeof(sorted));
+    qsort(sorted, COUNT, sizeof(sorted[0]), compare_ts);
+    assert(tz64_ts_to_tm_sorted(tz, sorted, actual, COUNT) == COUNT);
+
+    struct tz64_cursor fwd, rev;
+    tz64_cursor_init(&fwd, tz);
+    tz64_cursor_init(&rev, tz);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        assert(tz64_cursor_ts_to_tm(&fwd, sorted[i], &tm) == &tm);
+        assert_tm_eq(sorted[i], &tm, &actual[i]);
+
+        // Convert back with and without the cursor.
+        struct tm tm2 = tm;
+        assert(tz64_cursor_tm_to_ts(&rev, &tm) == tz64_tm_to_ts(tz, &tm2));
+        assert_tm_eq(sorted[i], &tm2, &tm);
+    }
+}
+
+
+// Check the offset and local seconds lookups against the full
+// conversions.
+static void check_offsets(const struct tz64 *tz)
+{
+    assert(tz64_offset_at_batch(tz, timestamps, infos, COUNT) == COUNT);
+    assert(tz64_ts_to_local_batch(tz, timestamps, locals, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tz64_offset_info info;
+        assert(tz64_offset_at(tz, timestamps[i], &info) == &info);
+        assert(info.utoff == expected[i].tm_gmtoff);
+        assert(info.isdst == expected[i].tm_isdst);
+        assert(strcmp(info.desig, expected[i].tm_zone) == 0);
+        assert(memcmp(&info, &infos[i], sizeof(info)) == 0);
+
+        // A leap second shares its local time with the second before.
+        struct tm tm = expected[i];
+        int64_t local = timegm(&tm) - (expected[i].tm_sec == 60);
+        assert(tz64_ts_to_local(tz, timestamps[i]) == local);
+        assert(locals[i] == local);
+    }
+}
+
+
+// Check that fields match the expected broken-down time i.
+static void assert_fields(const struct tz64 *tz, size_t i, const struct tz64_fields *f)
+{
+    struct tz64_offset_info info;
+    assert(tz64_fields_offset(tz, f, &info) == &info);
+
+    struct tm tm = expected[i];
+    tm.tm_year = f->year - 1900;
+    tm.tm_mon = f->mon - 1;
+    tm.tm_mday = f->mday;
+    tm.tm_hour = f->hour;
+    tm.tm_min = f->min;
+    tm.tm_sec = f->sec;
+    tm.tm_yday = f->yday;
+    tm.tm_wday = f->wday;
+    tm.tm_gmtoff = info.utoff;
+    tm.tm_isdst = info.isdst;
+    tm.tm_zone = info.desig;
+    assert_tm_eq(timestamps[i], &expected[i], &tm);
+}
+
+
+// Check conversions to compact broken-down time.
+static void check_fields(const struct tz64 *tz)
+{
+    assert(sizeof(struct tz64_fields) <= 16);
+
+    assert(tz64_ts_to_fields_batch(tz, timestamps, fields, COUNT, TZ64_FIELDS_ALL) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tz64_fields f;
+        assert(tz64_ts_to_fields(tz, timestamps[i], &f, TZ64_FIELDS_ALL) == &f);
+        assert_fields(tz, i, &f);
+        assert_fields(tz, i, &fields[i]);
+
+        // And back again, leaving the fields alone.
+        struct tz64_fields dup = f;
+        assert(tz64_fields_to_ts(tz, &f, TZ64_FIELDS_ALL) == timestamps[i]);
+        assert(memcmp(&f, &dup, sizeof(f)) == 0);
+
+        // Without the offset or time it's as if tm_isdst were -1 and
+        // the time midnight.
+        struct tm tm = expected[i];
+        tm.tm_isdst = -1;
+        tm.tm_gmtoff = 0;
+        assert(tz64_fields_to_ts(tz, &f, TZ64_FIELD_DATE | TZ64_FIELD_TIME) == tz64_tm_to_ts(tz, &tm));
+
+        tm = expected[i];
+        tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+        tm.tm_gmtoff = 0;
+        assert(tz64_fields_to_ts(tz, &f, TZ64_FIELD_DATE) == tz64_tm_to_ts(tz, &tm));
+
+        // Every local time that came from a timestamp exists, and
+        // resolves to it one way or the other.
+        struct tz64_resolution res;
+        assert(tz64_resolve_local(tz, &f, TZ64_RESOLVE_EARLIEST, &res) == &res);
+        assert(res.kind != TZ64_LOCAL_NONEXISTENT);
+        assert(res.ts == res.earliest && res.earliest <= res.latest);
+        assert(res.earliest == timestamps[i] || res.latest == timestamps[i]);
+        assert((res.kind == TZ64_LOCAL_NORMAL) == (res.earliest == res.latest));
+    }
+
+    // Fields out of their usual ranges are canonicalised.
+    struct tz64_fields f = { .year = 2022, .mon = 13, .mday = 32, .hour = 25, .min = 61, .sec = 61 };
+    struct tm tm = { .tm_year = 122, .tm_mon = 12, .tm_mday = 32, .tm_hour = 25, .tm_min = 61, .tm_sec = 61, .tm_isdst = -1 };
+    assert(tz64_fields_to_ts(tz, &f, TZ64_FIELD_DATE | TZ64_FIELD_TIME) == tz64_tm_to_ts(tz, &tm));
+
+    // Fields left out of the mask are left alone.
+    memset(fields, 0xff, sizeof(fields));
+    assert(tz64_ts_to_fields_batch(tz, timestamps, fields, COUNT, TZ64_FIELD_TIME) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tz64_fields f;
+        memset(&f, 0xff, sizeof(f));
+        assert(tz64_ts_to_fields(tz, timestamps[i], &f, TZ64_FIELD_TIME) == &f);
+        assert(memcmp(&f, &fields[i], sizeof(f)) == 0);
+        assert(f.hour == expected[i].tm_hour);
+        assert(f.min == expected[i].tm_min);
+        assert(f.sec == expected[i].tm_sec);
+        assert(f.year == -1 && f.mon == 0xff && f.wday == 0xff && f.yday == 0xffff && f.offset == 0xff);
+    }
+
+    memset(fields, 0xff, sizeof(fields));
+    assert(tz64_ts_to_fields_batch(tz, timestamps, fields, COUNT, TZ64_FIELD_YDAY | TZ64_FIELD_WDAY) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tz64_fields f;
+        memset(&f, 0xff, sizeof(f));
+        assert(tz64_ts_to_fields(tz, timestamps[i], &f, TZ64_FIELD_YDAY | TZ64_FIELD_WDAY) == &f);
+        assert(memcmp(&f, &fields[i], sizeof(f)) == 0);
+        assert(f.yday == expected[i].tm_yday);
+        assert(f.wday == expected[i].tm_wday);
+        assert(f.year == -1 && f.hour == 0xff && f.offset == 0xff);
+    }
+}
+
+
+// Check conversions of times in units of 1/per_sec seconds, using the
+// whole-second timestamps that fit.
+static void check_units(const struct tz64 *tz, int64_t per_sec)
+{
+    const int64_t limit = INT64_MAX / per_sec - 1;
+    for (size_t i = 0; i < COUNT; i++) {
+        int64_t ts = timestamps[i] % limit;
+        units[i] = ts * per_sec + (int64_t)(i * 7919) % per_sec;
+        if (i % 2 == 1) {
+            units[i] -= per_sec - 1;
+        }
+    }
+
+    memset(actual, 0, sizeof(actual));
+    const size_t n = (per_sec == 1000000000) ?
+        tz64_ns_to_tm_batch(tz, units, actual, fracs, COUNT) :
+        tz64_us_to_tm_batch(tz, units, actual, fracs, COUNT);
+    assert(n == COUNT);
+
+    for (size_t i = 0; i < COUNT; i++) {
+        // Work out the expected seconds and fraction the slow way.
+        int64_t ts = units[i] / per_sec;
+        int64_t frac = units[i] % per_sec;
+        if (frac < 0) {
+            ts--;
+            frac += per_sec;
+        }
+
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        assert(tz64_ts_to_tm(tz, ts, &tm) == &tm);
+        assert_tm_eq(ts, &tm, &actual[i]);
+        assert(fracs[i] == frac);
+
+        struct tm tm2;
+        int32_t frac2;
+        memset(&tm2, 0, sizeof(tm2));
+        if (per_sec == 1000000000) {
+            assert(tz64_ns_to_tm(tz, units[i], &tm2, &frac2) == &tm2);
+        } else {
+            assert(tz64_us_to_tm(tz, units[i], &tm2, &frac2) == &tm2);
+        }
+        assert_tm_eq(ts, &tm, &tm2);
+        assert(frac2 == frac);
+
+        // And back again.
+        const int64_t back = (per_sec == 1000000000) ?
+            tz64_tm_to_ns(tz, &tm2, frac2) :
+            tz64_tm_to_us(tz, &tm2, frac2);
+        assert(back == units[i]);
+    }
+}
+
+
+// Convert the columns back to timestamps and check the results
+// against tz64_tm_to_ts.
+static void check_columns_to_ts(const struct tz64 *tz, const struct tz64_columns *cols)
+{
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        tm.tm_year = cols->year[i] - 1900;
+        tm.tm_mon = cols->mon[i] - 1;
+        tm.tm_mday = cols->mday[i];
+        tm.tm_hour = cols->hour[i];
+        tm.tm_min = cols->min[i];
+        tm.tm_sec = cols->sec[i];
+        tm.tm_isdst = (cols->isdst != NULL) ? cols->isdst[i] : -1;
+        tm.tm_gmtoff = (cols->utoff != NULL) ? cols->utoff[i] : 0;
+        sorted[i] = tz64_tm_to_ts(tz, &tm);
+    }
+
+    memset(locals, 0, sizeof(locals));
+    assert(tz64_columns_to_ts(tz, cols, locals, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        assert(locals[i] == sorted[i]);
+    }
+}
+
+
+// Step broken-down times forwards and backwards by various amounts,
+// across transitions and leap seconds, and compare with converting
+// from scratch.
+static void check_advance(const struct tz64 *tz)
+{
+    static const int64_t deltas[] = { 1, -1, 59, 61, -61, 3599, 3600, -7200, 86399, 86400, -86400, 86401, 1000000 };
+    const size_t ndeltas = sizeof(deltas) / sizeof(deltas[0]);
+
+    for (size_t i = 0; i < COUNT; i++) {
+        const int64_t ts = timestamps[i];
+        const int64_t delta = deltas[i % ndeltas];
+
+        struct tm tm = expected[i], ref;
+        memset(&ref, 0, sizeof(ref));
+        if (tz64_ts_to_tm(tz, ts + delta, &ref) == NULL) {
+            continue;
+        }
+        assert(tz64_tm_advance(tz, &tm, ts, ts + delta) == &tm);
+        assert_tm_eq(ts + delta, &ref, &tm);
+
+        // And back again.
+        assert(tz64_tm_advance(tz, &tm, ts + delta, ts) == &tm);
+        assert_tm_eq(ts, &expected[i], &tm);
+
+        // Move the wall clock instead.
+        tm = expected[i];
+        ref = expected[i];
+        ref.tm_sec += delta;
+        const int64_t ref_ts = tz64_tm_to_ts(tz, &ref);
+        assert(tz64_tm_advance_local(tz, &tm, ts, delta) == ref_ts);
+        assert_tm_eq(ref_ts, &ref, &tm);
+    }
+
+    // Walk a grid of minutes through a year.
+    struct tm tm;
+    int64_t ts = 1640995200;
+    assert(tz64_ts_to_tm(tz, ts, &tm) == &tm);
+    for (int i = 0; i < 366 * 24 * 60; i++, ts += 60) {
+        struct tm ref;
+        assert(tz64_tm_advance(tz, &tm, ts, ts + 60) == &tm);
+        assert(tz64_ts_to_tm(tz, ts + 60, &ref) == &ref);
+        assert_tm_eq(ts + 60, &ref, &tm);
+    }
+}
+
+
+static void check_tz(const char *name)
+{
+    // Convert the timestamps one at a time and then all at once, and
+    // make sure they agree.
+    struct tz64 *tz = load_reference(name, timestamps, expected, COUNT);
+
+    memset(actual, 0, sizeof(actual));
+    assert(tz64_ts_to_tm_batch(tz, timestamps, actual, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        assert_tm_eq(timestamps[i], &expected[i], &actual[i]);
+    }
+
+    check_cursor(tz);
+    check_offsets(tz);
+    check_fields(tz);
+    check_advance(tz);
+    check_units(tz, 1000000000);
+    check_units(tz, 1000000);
+
+    // Repeat with columns.
+    struct tz64_columns cols = {
+        year, mon, mday, hour, min, sec, yday, wday, utoff, isdst
+    };
+    assert(tz64_ts_to_columns(tz, timestamps, &cols, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tm tm = expected[i];
+        tm.tm_year = year[i] - 1900;
+        tm.tm_mon = mon[i] - 1;
+        tm.tm_mday = mday[i];
+        tm.tm_hour = hour[i];
+        tm.tm_min = min[i];
+        tm.tm_sec = sec[i];
+        tm.tm_yday = yday[i];
+        tm.tm_wday = wday[i];
+        tm.tm_gmtoff = utoff[i];
+        tm.tm_isdst = isdst[i];
+        assert_tm_eq(timestamps[i], &expected[i], &tm);
+    }
+
+    // Convert the columns back, with and without the hints, and again
+    // with some rows out of their usual ranges.
+    check_columns_to_ts(tz, &cols);
+    for (size_t i = 0; i < COUNT; i++) {
+        assert(locals[i] == timestamps[i]);
+    }
+
+    struct tz64_columns unhinted = cols;
+    unhinted.isdst = NULL;
+    unhinted.utoff = NULL;
+    check_columns_to_ts(tz, &unhinted);
+
+    for (size_t i = 0; i + 3 < COUNT; i += 7) {
+        mon[i] += 12;
+        sec[i + 1] -= 61;
+        mday[i + 2] += 31;
+        hour[i + 3] = 24;
+    }
+    check_columns_to_ts(tz, &cols);
+
+    // A year that can't be converted stops the batch.
+    year[COUNT / 2] = INT32_MIN;
+    errno = 0;
+    assert(tz64_columns_to_ts(tz, &cols, locals, COUNT) == COUNT / 2);
+    assert(errno == EOVERFLOW);
+
+    // Columns may be skipped.
+    memset(hour, 0, sizeof(hour));
+    struct tz64_columns hours = { .hour = hour };
+    assert(tz64_ts_to_columns(tz, timestamps, &hours, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        assert(hour[i] == expected[i].tm_hour);
+    }
+
+    // A timestamp that can't be converted stops the batch.
+    timestamps[COUNT / 3] = INT64_MAX;
+    errno = 0;
+    assert(tz64_ts_to_tm_batch(tz, timestamps, actual, COUNT) == COUNT / 3);
+    assert(errno == EOVERFLOW);
+
+    errno = 0;
+    assert(tz64_ts_to_columns(tz, timestamps, &cols, COUNT) == COUNT / 3);
+    assert(errno == EOVERFLOW);
+
+    errno = 0;
+    assert(tz64_offset_at_batch(tz, timestamps, infos, COUNT) == COUNT / 3);
+    assert(errno == EOVERFLOW);
+
+    errno = 0;
+    assert(tz64_ts_to_local_batch(tz, timestamps, locals, COUNT) == COUNT / 3);
+    assert(errno == EOVERFLOW);
+
+    tz64_free(tz);
+}
+
+
+// Convert the fields of each timestamp in from to to, both with and
+// without the offset, and compare with a round trip through a
+// timestamp.
+static void check_convert(const struct tz64 *from, const struct tz64 *to)
+{
+    static const unsigned int masks[] = {
+        TZ64_FIELDS_ALL,
+        TZ64_FIELD_DATE | TZ64_FIELD_TIME | TZ64_FIELD_WDAY,
+        TZ64_FIELD_DATE
+    };
+
+    for (size_t m = 0; m < sizeof(masks) / sizeof(masks[0]); m++) {
+        const unsigned int mask = masks[m];
+        size_t n = 0;
+        for (size_t j = 0; j < COUNT; j++) {
+            if (tz64_ts_to_fields(from, timestamps[j], &fields[n], TZ64_FIELDS_ALL) != NULL) {
+                n++;
+            }
+        }
+
+        // Push a few times out of their usual ranges or into gaps.
+        fields[0].hour = 2;
+        fields[0].min = 30;
+        fields[1].sec = 59;
+        fields[1].min = 200;
+        fields[2].mday = 31;
+        fields[2].mon = 2;
+
+        static struct tz64_fields out[COUNT];
+        errno = 0;
+        const size_t converted = tz64_convert_batch(from, to, fields, out, n, mask);
+        for (size_t j = 0; j < n; j++) {
+            struct tz64_fields scalar, ref;
+            memset(&scalar, 0, sizeof(scalar));
+            memset(&ref, 0, sizeof(ref));
+
+            const int64_t ts = tz64_fields_to_ts(from, &fields[j], mask);
+            if (tz64_ts_to_fields(to, ts, &ref, mask) == NULL) {
+                assert(tz64_convert(from, to, &fields[j], &scalar, mask) == NULL);
+                assert(converted == j && errno == EOVERFLOW);
+                break;
+            }
+
+            assert(tz64_convert(from, to, &fields[j], &scalar, mask) == &scalar);
+            assert(memcmp(&scalar, &ref, sizeof(ref)) == 0);
+
+            // The batch writes only the selected members, and the day
+            // of the year along with the date.
+            struct tz64_fields batch = out[j];
+            if (!(mask & TZ64_FIELD_TIME)) {
+                batch.hour = batch.min = batch.sec = 0;
+            }
+            if (!(mask & TZ64_FIELD_WDAY)) {
+                batch.wday = 0;
+            }
+            if (!(mask & (TZ64_FIELD_DATE | TZ64_FIELD_YDAY))) {
+                batch.yday = 0;
+            }
+            if (!(mask & TZ64_FIELD_OFFSET)) {
+                batch.offset = 0;
+            }
+            assert(memcmp(&batch, &ref, sizeof(ref)) == 0);
+        }
+    }
+}
+
+
+// Convert each timestamp into all of the time zones at once and
+// compare with converting into each in turn.
+static void check_zones(void)
+{
+    const size_t count = sizeof(tz_names) / sizeof(tz_names[0]) - 1;
+    struct tz64 *zones[count];
+    for (size_t i = 0; i < count; i++) {
+        zones[i] = tz64_alloc(tz_names[i]);
+        assert(zones[i] != NULL);
+    }
+
+    // Start with timestamps around New York's transitions.
+    fill_timestamps(zones[0], timestamps, COUNT);
+
+    // Convert them with each row in a different zone, in no
+    // particular order.
+    static const struct tz64 *mixed[COUNT];
+    for (size_t j = 0; j < COUNT; j++) {
+        mixed[j] = zones[(j * 7 + j / 3) % count];
+    }
+
+    assert(tz64_ts_to_tm_mixed(mixed, timestamps, actual, COUNT) == COUNT);
+    for (size_t j = 0; j < COUNT; j++) {
+        struct tm ref;
+        memset(&ref, 0, sizeof(ref));
+        assert(tz64_ts_to_tm(mixed[j], timestamps[j], &ref) == &ref);
+        assert_tm_eq(timestamps[j], &ref, &actual[j]);
+    }
+
+    // Conversion stops at the first row that can't be converted.
+    const int64_t saved = timestamps[COUNT / 2];
+    timestamps[COUNT / 2] = INT64_MAX;
+    errno = 0;
+    assert(tz64_ts_to_tm_mixed(mixed, timestamps, actual, COUNT) == COUNT / 2);
+    assert(errno == EOVERFLOW);
+    timestamps[COUNT / 2] = saved;
+
+    // Convert between each pair of zones.
+    for (size_t a = 0; a < count; a++) {
+        for (size_t b = 0; b < count; b++) {
+            check_convert(zones[a], zones[b]);
+        }
+    }
+
+    // For the fan-out, add a leap second and the last half hour of the
+    // last year struct tm can hold, which is the next year in UTC but
+    // not in New York.
+    struct tm last;
+    memset(&last, 0, sizeof(last));
+    last.tm_year = INT32_MAX;
+    last.tm_mon = 11;
+    last.tm_mday = 31;
+    last.tm_hour = 23;
+    last.tm_min = 30;
+    timestamps[0] = tz64_tm_to_ts(zones[count - 1], &last);
+    timestamps[1] = timestamps[0] + 3600;
+    timestamps[2] = 78796799;
+    timestamps[3] = 78796800;
+
+    struct tm tm[count];
+    for (size_t j = 0; j < COUNT; j++) {
+        // The zones before a failure are converted; the failing one
+        // must fail on its own too.
+        errno = 0;
+        size_t n = tz64_ts_to_tm_zones((const struct tz64 *const *)zones, count, timestamps[j], tm);
+        if (n != count) {
+            struct tm ref;
+            assert(errno == EOVERFLOW);
+            assert(tz64_ts_to_tm(zones[n], timestamps[j], &ref) == NULL);
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            struct tm ref;
+            memset(&ref, 0, sizeof(ref));
+            assert(tz64_ts_to_tm(zones[i], timestamps[j], &ref) == &ref);
+            assert_tm_eq(timestamps[j], &ref, &tm[i]);
+        }
+    }
+
+    errno = 0;
+    assert(tz64_ts_to_tm_zones((const struct tz64 *const *)zones, count, INT64_MAX, tm) == 0);
+    assert(errno == EOVERFLOW);
+
+    for (size_t i = 0; i < count; i++) {
+        tz64_free(zones[i]);
+    }
+}
+
+
+// Check the UTC functions against the UTC time zone.
+static void check_utc(void)
+{
+    struct tz64 *tz = tz64_alloc("UTC");
+    assert(tz != NULL);
+    fill_timestamps(tz, timestamps, COUNT);
+
+    memset(actual, 0, sizeof(actual));
+    assert(tz64_gmtime_batch(timestamps, actual, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tm tm;
+        memset(&expected[i], 0, sizeof(expected[i]));
+        assert(tz64_ts_to_tm(tz, timestamps[i], &expected[i]) == &expected[i]);
+        assert(tz64_gmtime(timestamps[i], &tm) == &tm);
+        assert_tm_eq(timestamps[i], &expected[i], &tm);
+        assert_tm_eq(timestamps[i], &expected[i], &actual[i]);
+    }
+
+    // And back again, with some of the fields pushed out of range.
+    for (size_t i = 0; i < COUNT; i++) {
+        switch (i % 4) {
+        case 1:
+            actual[i].tm_mday += 40;
+            break;
+        case 2:
+            actual[i].tm_sec -= 100000;
+            break;
+        case 3:
+            actual[i].tm_mon = 1;
+            actual[i].tm_mday = 29;
+            break;
+        }
+        actual[i].tm_wday = actual[i].tm_yday = -1;
+        expected[i] = actual[i];
+    }
+
+    assert(tz64_timegm_batch(actual, sorted, COUNT) == COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        struct tm tm = expected[i];
+        const int64_t ts = tz64_tm_to_ts(tz, &expected[i]);
+        assert(tz64_timegm(&tm) == ts);
+        assert(sorted[i] == ts);
+        assert_tm_eq(ts, &expected[i], &tm);
+        assert_tm_eq(ts, &expected[i], &actual[i]);
+    }
+
+    // Both stop at the first failure.
+    timestamps[COUNT / 2] = INT64_MAX;
+    errno = 0;
+    assert(tz64_gmtime_batch(timestamps, actual, COUNT) == COUNT / 2);
+    assert(errno == EOVERFLOW);
+
+    actual[COUNT / 2].tm_year = INT32_MAX;
+    actual[COUNT / 2].tm_mon = 12;
+    errno = 0;
+    assert(tz64_timegm_batch(actual, sorted, COUNT) == COUNT / 2);
+    assert(errno == EOVERFLOW);
+
+    tz64_free(tz);
+}
+
+
+int main(int argc, char *argv[])
+{
+    for (int i = 0; tz_names[i] != NULL; i++) {
+        check_tz(tz_names[i]);
+    }
+
+    check_zones();
+    check_utc();
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <tz64.h>
+#include <tz64file.h>
+#include "utils.h"
+
+static const char *tz_names[] = {
+    "America/New_York",
+    "Australia/Melbourne",
+    "Asia/Hong_Kong",
+    "Europe/London",
+    "right/Europe/London",
+    NULL
+};
+
+#define NAME_COUNT (sizeof(tz_names) / sizeof(tz_names[0]) - 1)
+
+
+int main(int argc, char *argv[])
+{
+    const char *tmpdir = getenv("TMPDIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/test-bundle.XXXXXX", (tmpdir != NULL) ? tmpdir : "/tmp");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    // Bundle some time zones, one of them under two names, and with
+    // expanded rules.
+    struct tz64_options opts;
+    tz64_options_init(&opts);
+    opts.expand_rules = 1;
+
+    const char *names[NAME_COUNT + 2];
+    const struct tz64 *zones[NAME_COUNT + 2];
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        names[i] = tz_names[i];
+        zones[i] = tz64_alloc(tz_names[i]);
+        assert(zones[i] != NULL);
+    }
+
+    names[NAME_COUNT] = "US/Eastern";
+    zones[NAME_COUNT] = zones[0];
+    names[NAME_COUNT + 1] = "Expanded/Melbourne";
+    zones[NAME_COUNT + 1] = tz64_alloc_with("Australia/Melbourne", &opts);
+    assert(zones[NAME_COUNT + 1] != NULL);
+    assert(tz64_bundle_write(path, names, zones, NAME_COUNT + 2) == 0);
+
+    // Every name gives a time zone that behaves like the original.
+    struct tz64_bundle *bundle = tz64_bundle_open(path);
+    assert(bundle != NULL);
+    for (size_t i = 0; i < NAME_COUNT + 2; i++) {
+        const struct tz64 *tz = tz64_bundle_find(bundle, names[i]);
+        assert(tz != NULL);
+        assert(tz64_bundle_find(bundle, names[i]) == tz);
+        check_same(zones[i], tz);
+    }
+
+    // Both names for New York share their tables.
+    assert(tz64_bundle_find(bundle, "US/Eastern")->timestamps ==
+           tz64_bundle_find(bundle, "America/New_York")->timestamps);
+
+    errno = 0;
+    assert(tz64_bundle_find(bundle, "Europe/Paris") == NULL);
+    assert(errno == ENOENT);
+
+    // Time zones found in a bundle can't be bundled again, and freeing
+    // one leaves it to the bundle.
+    char copy_path[256];
+    snprintf(copy_path, sizeof(copy_path), "%s.copy", path);
+    const struct tz64 *found = tz64_bundle_find(bundle, "Europe/London");
+    errno = 0;
+    assert(tz64_bundle_write(copy_path, &names[3], &found, 1) == -1);
+    assert(errno == EINVAL);
+    unlink(copy_path);
+    tz64_free((struct tz64 *)found);
+    check_same(zones[3], found);
+    tz64_bundle_close(bundle);
+
+    // Time zones made from POSIX TZ strings can't be bundled.
+    struct tz64 *posix = tz64_alloc("EST5EDT,M3.2.0,M11.1.0");
+    assert(posix != NULL);
+    const char *posix_name = "EST5EDT";
+    const struct tz64 *posix_zone = posix;
+    errno = 0;
+    assert(tz64_bundle_write(path, &posix_name, &posix_zone, 1) == -1);
+    assert(errno == EINVAL);
+    tz64_free(posix);
+
+    // Nor can TZif files be opened as bundles.
+    errno = 0;
+    assert(tz64_bundle_open("/usr/share/zoneinfo/America/New_York") == NULL);
+    assert(errno == EINVAL);
+
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        tz64_free((struct tz64 *)zones[i]);
+    }
+    tz64_free((struct tz64 *)zones[NAME_COUNT + 1]);
+    unlink(path);
+    return 0;
+}
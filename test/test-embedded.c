@@ -0,0 +1,97 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <tz64.h>
+#include <tz64file.h>
+#include "utils.h"
+
+// The time zones in embedded-zones.c and the files they came from.
+static const char *tz_names[][2] = {
+    { "America/New_York", "/usr/share/zoneinfo/America/New_York" },
+    { "US/Eastern", "/usr/share/zoneinfo/America/New_York" },
+    { "Asia/Hong_Kong", "/usr/share/zoneinfo/Asia/Hong_Kong" },
+    { "right/Europe/London", "/usr/share/zoneinfo/right/Europe/London" },
+    { NULL, NULL }
+};
+
+
+int main(int argc, char *argv[])
+{
+    for (int i = 0; tz_names[i][0] != NULL; i++) {
+        // Names give the compiled-in time zone, which behaves like the
+        // one loaded from its file.
+        struct tz64 *tz = tz64_alloc(tz_names[i][0]);
+        assert(tz != NULL && tz->size == 0);
+        char desc[64];
+        snprintf(desc, sizeof(desc), ":%s", tz_names[i][0]);
+        assert(tz64_alloc(desc) == tz);
+        assert(tz64_acquire(tz_names[i][0]) == tz);
+        tz64_release(tz);
+
+        struct tz64 *file_tz = tz64_alloc(tz_names[i][1]);
+        assert(file_tz != NULL && file_tz != tz && file_tz->size != 0);
+        check_same(file_tz, tz);
+        tz64_free(file_tz);
+        tz64_free(tz);
+    }
+
+    // Links to the same file share a time zone.
+    assert(tz64_alloc("US/Eastern") == tz64_alloc("America/New_York"));
+
+    // Other options mean loading the file.
+    struct tz64_options opts;
+    tz64_options_init(&opts);
+    opts.expand_rules = 1;
+    struct tz64 *tz = tz64_alloc_with("Asia/Hong_Kong", &opts);
+    assert(tz != NULL && tz->size != 0);
+    check_same(tz64_alloc("Asia/Hong_Kong"), tz);
+    tz64_free(tz);
+
+    // Names that weren't compiled in still work.
+    tz = tz64_alloc("Europe/London");
+    assert(tz != NULL && tz->size != 0);
+    tz64_free(tz);
+
+    // Compiled-in time zones can't be bundled.
+    const char *tmpdir = getenv("TMPDIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/test-embedded.XXXXXX", (tmpdir != NULL) ? tmpdir : "/tmp");
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    const char *name = "America/New_York";
+    const struct tz64 *zone = tz64_alloc(name);
+    errno = 0;
+    assert(tz64_bundle_write(path, &name, &zone, 1) == -1);
+    assert(errno == EINVAL);
+    unlink(path);
+
+    return 0;
+}
@@ -173,6 +173,43 @@ static int check_ts(const struct tz64 *tz, time_t ts)
 }
 
 
+// Find the rule-based transitions after the last explicit one by
+// stepping a day at a time and bisecting whenever the offset changes,
+// and check the seconds around each one.
+static void check_rule_transitions(const struct tz64 *tz)
+{
+    struct tm tm;
+    int64_t prev_ts = tz->timestamps[tz->ts_count - 1];
+    assert(tz64_ts_to_tm(tz, prev_ts, &tm) != NULL);
+    long prev_off = tm.tm_gmtoff;
+
+    for (int64_t ts = prev_ts + 86400; ts <= end_ts; prev_ts = ts, ts += 86400) {
+        assert(tz64_ts_to_tm(tz, ts, &tm) != NULL);
+        if (tm.tm_gmtoff == prev_off) {
+            continue;
+        }
+
+        int64_t lo = prev_ts, hi = ts;
+        while (lo + 1 < hi) {
+            int64_t mid = lo + (hi - lo) / 2;
+            assert(tz64_ts_to_tm(tz, mid, &tm) != NULL);
+            if (tm.tm_gmtoff == prev_off) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+
+        check_ts(tz, hi - 1);
+        check_ts(tz, hi);
+        check_ts(tz, hi + 1);
+
+        assert(tz64_ts_to_tm(tz, ts, &tm) != NULL);
+        prev_off = tm.tm_gmtoff;
+    }
+}
+
+
 static void check_tz(const char *name)
 {
     // Set the time zone.
@@ -183,6 +220,25 @@ static void check_tz(const char *name)
     struct tz64 *tz = tz64_alloc(name);
     assert(tz != NULL);
 
+    // And again with a finer index covering more of history, and with
+    // no index at all.
+    struct tz64_options opts;
+    tz64_options_init(&opts);
+    opts.index_begin = begin_ts;
+    opts.index_shift = 12;
+    struct tz64 *tz_fine = tz64_alloc_with(name, &opts);
+    assert(tz_fine != NULL);
+
+    opts.index_end = opts.index_begin;
+    struct tz64 *tz_plain = tz64_alloc_with(name, &opts);
+    assert(tz_plain != NULL);
+
+    // And with the rules expanded.
+    tz64_options_init(&opts);
+    opts.expand_rules = 1;
+    struct tz64 *tz_expanded = tz64_alloc_with(name, &opts);
+    assert(tz_expanded != NULL);
+
     if (exhaustive) {
         printf("%s:", name);
         fflush(stdout);
@@ -203,6 +259,10 @@ static void check_tz(const char *name)
             int64_t ts = tz->timestamps[i];
             check_ts(tz, ts - 1);
             check_ts(tz, ts);
+            check_ts(tz_fine, ts - 1);
+            check_ts(tz_fine, ts);
+            check_ts(tz_plain, ts - 1);
+            check_ts(tz_plain, ts);
         }
 
         // Repeat for leap second transitions.
@@ -212,9 +272,16 @@ static void check_tz(const char *name)
             check_ts(tz, ts);
             check_ts(tz, ts + 1);
         }
+
+        // Check the transitions derived from the rules.
+        check_rule_transitions(tz);
+        check_rule_transitions(tz_expanded);
     }
 
     tz64_free(tz);
+    tz64_free(tz_fine);
+    tz64_free(tz_plain);
+    tz64_free(tz_expanded);
 }
 
 
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <errno.h>
 #include <assert.h>
 #include <tz64.h>
 #include <tz64file.h>
@@ -137,6 +138,45 @@ int main(int argc, char *argv[])
     assert(tz64_tm_to_ts(tz_new_york, &tm) == ts);
     assert_tm(ts, 2012, 3, 11, 1, 30, 0, 0, DOW_SUN, 71, -5 * 3600, "EST", &tm);
 
+    // Resolve the same times by policy, which gives both candidates.
+    struct tz64 *ny_zones[] = { tz_new_york, tz_ny2 };
+    for (int i = 0; i < 2; i++) {
+        struct tz64_resolution res;
+        struct tz64_fields fields = { .year = 2012, .mon = 11, .mday = 4, .hour = 1, .min = 30 };
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_EARLIEST, &res) == &res);
+        assert(res.kind == TZ64_LOCAL_AMBIGUOUS);
+        assert(res.ts == 1352008800 - 1800);
+        assert(res.earliest == 1352008800 - 1800 && res.latest == 1352008800 + 1800);
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_LATEST, &res) == &res);
+        assert(res.ts == 1352008800 + 1800);
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_SHIFT_FORWARD, &res) == &res);
+        assert(res.ts == 1352008800 - 1800);
+        errno = 0;
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_REJECT, &res) == NULL);
+        assert(errno == EINVAL && res.kind == TZ64_LOCAL_AMBIGUOUS);
+
+        fields.mon = 3;
+        fields.mday = 11;
+        fields.hour = 2;
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_EARLIEST, &res) == &res);
+        assert(res.kind == TZ64_LOCAL_NONEXISTENT);
+        assert(res.ts == 1331449200 - 1800);
+        assert(res.earliest == 1331449200 - 1800 && res.latest == 1331449200 + 1800);
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_LATEST, &res) == &res);
+        assert(res.ts == 1331449200 + 1800);
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_SHIFT_FORWARD, &res) == &res);
+        assert(res.ts == 1331449200);
+        errno = 0;
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_REJECT, &res) == NULL);
+        assert(errno == EINVAL && res.kind == TZ64_LOCAL_NONEXISTENT);
+
+        // A normal time has just the one.
+        fields.hour = 4;
+        assert(tz64_resolve_local(ny_zones[i], &fields, TZ64_RESOLVE_REJECT, &res) == &res);
+        assert(res.kind == TZ64_LOCAL_NORMAL);
+        assert(res.ts == 1331449200 + 5400 && res.earliest == res.ts && res.latest == res.ts);
+    }
+
     // Set up a tm based on seconds.
     ts = 1660912736;
     init_tm(&tm, 1970, 1, 1, 0, 0, 0, -1);
@@ -0,0 +1,223 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <tz64.h>
+#include <tz64file.h>
+#include "utils.h"
+
+#define THREADS 8
+#define ROUNDS 20000
+
+static const char *tz_names[] = {
+    "America/New_York",
+    ":America/New_York",
+    "/usr/share/zoneinfo/America/New_York",
+    "Australia/Melbourne",
+    "Asia/Hong_Kong",
+    "Europe/London",
+    "right/Europe/London",
+    "EST5EDT,M3.2.0,M11.1.0",
+    "HKT-8",
+    "",
+    NULL
+};
+
+#define NAME_COUNT (sizeof(tz_names) / sizeof(tz_names[0]) - 1)
+
+// Each name's time zone loaded the ordinary way, for comparison.
+static struct tz64 *reference[NAME_COUNT];
+
+
+// Check that a time zone converts a few timestamps as the reference
+// time zone for a name does.
+static void check_reference(const struct tz64 *tz, size_t name, uint64_t seed)
+{
+    for (int i = 0; i < 4; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        const int64_t ts = (int64_t)(seed % INT64_C(4000000000)) - INT64_C(1000000000);
+
+        struct tm expected, actual;
+        memset(&expected, 0, sizeof(expected));
+        memset(&actual, 0, sizeof(actual));
+        assert(tz64_ts_to_tm(reference[name], ts, &expected) == &expected);
+        assert(tz64_ts_to_tm(tz, ts, &actual) == &actual);
+        assert_tm_eq(ts, &expected, &actual);
+    }
+}
+
+
+// Copy a time zone's file to a new path.
+static void copy_zone(const char *name, const char *path)
+{
+    size_t size;
+    char *data = read_zone_file(name, &size);
+    FILE *out = fopen(path, "wb");
+    assert(out != NULL);
+    assert(fwrite(data, size, 1, out) == 1);
+    assert(fclose(out) == 0);
+    free(data);
+}
+
+
+// Check that the registry evicts the least recently used time zone
+// first.  Each zone is loaded from a copy of its file which is then
+// removed, so a zone that was evicted can't be loaded again.
+static void check_eviction_order(void)
+{
+    static const char *names[] = { "America/New_York", "Europe/London", "Asia/Hong_Kong" };
+    const char *tmpdir = getenv("TMPDIR");
+    char dir[256];
+    snprintf(dir, sizeof(dir), "%s/test-registry.XXXXXX", (tmpdir != NULL) ? tmpdir : "/tmp");
+    assert(mkdtemp(dir) != NULL);
+
+    tz64_registry_set_limit(1);
+    tz64_registry_set_limit(0);
+
+    char paths[3][300];
+    size_t sizes[3];
+    for (size_t i = 0; i < 3; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%zu", dir, i);
+        copy_zone(names[i], paths[i]);
+        const struct tz64 *tz = tz64_acquire(paths[i]);
+        assert(tz != NULL);
+        sizes[i] = tz->size;
+        tz64_release(tz);
+    }
+
+    // Use the first again, leaving the second least recently used.
+    const struct tz64 *tz = tz64_acquire(paths[0]);
+    assert(tz != NULL);
+    tz64_release(tz);
+
+    tz64_registry_set_limit(sizes[0] + sizes[2]);
+    for (size_t i = 0; i < 3; i++) {
+        assert(unlink(paths[i]) == 0);
+    }
+
+    assert(rmdir(dir) == 0);
+    for (size_t i = 0; i < 3; i++) {
+        tz = tz64_acquire(paths[i]);
+        assert((tz == NULL) == (i == 1));
+        if (tz != NULL) {
+            check_reference(tz, i == 0 ? 0 : 4, i);
+            tz64_release(tz);
+        }
+    }
+}
+
+
+// Acquire, use and release random time zones.
+static void *churn(void *arg)
+{
+    uint64_t seed = 88172645463325252ull + (uintptr_t)arg;
+    for (int i = 0; i < ROUNDS; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        const size_t name = seed % NAME_COUNT;
+
+        const struct tz64 *tz = tz64_acquire(tz_names[name]);
+        assert(tz != NULL);
+        check_reference(tz, name, seed);
+        tz64_release(tz);
+    }
+
+    return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        reference[i] = tz64_alloc(tz_names[i]);
+        assert(reference[i] != NULL);
+    }
+
+    // The same description gives the same time zone, and so do other
+    // descriptions of the same file.
+    const struct tz64 *ny = tz64_acquire("America/New_York");
+    assert(ny != NULL);
+    assert(tz64_acquire("America/New_York") == ny);
+    assert(tz64_acquire(":America/New_York") == ny);
+    assert(tz64_acquire("/usr/share/zoneinfo/America/New_York") == ny);
+    check_reference(ny, 0, 1);
+
+    const struct tz64 *london = tz64_acquire("Europe/London");
+    assert(london != NULL && london != ny);
+    const struct tz64 *posix = tz64_acquire("EST5EDT,M3.2.0,M11.1.0");
+    assert(posix != NULL && posix != ny);
+    check_reference(posix, 7, 2);
+
+    errno = 0;
+    assert(tz64_acquire("No/Such/Zone") == NULL);
+    assert(errno != 0);
+
+    // Time zones that have been acquired survive any limit.
+    tz64_release(london);
+    tz64_release(posix);
+    tz64_registry_set_limit(1);
+    check_reference(ny, 0, 3);
+    assert(tz64_acquire("America/New_York") == ny);
+    for (int i = 0; i < 5; i++) {
+        tz64_release(ny);
+    }
+
+    // Now hammer the registry from several threads with a limit small
+    // enough that time zones come and go.
+    tz64_registry_set_limit(16384);
+    pthread_t threads[THREADS];
+    for (uintptr_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, churn, (void *)i) == 0);
+    }
+
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    // And again with no limit.
+    tz64_registry_set_limit(0);
+    for (uintptr_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, churn, (void *)i) == 0);
+    }
+
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+
+    check_eviction_order();
+
+    tz64_registry_set_limit(1);
+    for (size_t i = 0; i < NAME_COUNT; i++) {
+        tz64_free(reference[i]);
+    }
+
+    return 0;
+}
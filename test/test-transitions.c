@@ -0,0 +1,168 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <tz64.h>
+#include <tz64file.h>
+#include "utils.h"
+
+#define MAX_TRANSITIONS 4096
+
+static const char *tz_names[] = {
+    "America/New_York",
+    "Australia/Melbourne",
+    "Asia/Hong_Kong",
+    "Europe/London",
+    "right/Europe/London",
+    "EST5EDT,M3.2.0,M11.1.0",
+    "AEST-10AEDT,M10.1.0,M4.1.0/3",
+    "HKT-8",
+    "UTC",
+    NULL
+};
+
+// 1800-01-01 and 2500-01-01.
+static const int64_t begin_ts = INT64_C(-5364662400);
+static const int64_t end_ts = INT64_C(16725225600);
+
+static struct tz64_transition transitions[MAX_TRANSITIONS];
+
+
+static void assert_info_eq(const struct tz64_offset_info *a, const struct tz64_offset_info *b)
+{
+    assert(a->utoff == b->utoff);
+    assert(a->isdst == b->isdst);
+    assert(strcmp(a->desig, b->desig) == 0);
+}
+
+
+static void assert_transition_eq(const struct tz64_transition *a, const struct tz64_transition *b)
+{
+    assert(a->ts == b->ts);
+    assert_info_eq(&a->before, &b->before);
+    assert_info_eq(&a->after, &b->after);
+}
+
+
+// Check that the transitions either side of ts agree with the offset
+// in effect at ts.
+static void check_ts(const struct tz64 *tz, int64_t ts, size_t count)
+{
+    struct tz64_offset_info info;
+    assert(tz64_offset_at(tz, ts, &info) == &info);
+
+    struct tz64_transition prev, next;
+    if (tz64_prev_transition(tz, ts, &prev) != NULL) {
+        assert(prev.ts <= ts);
+        assert_info_eq(&prev.after, &info);
+    } else {
+        assert(errno == ENOENT);
+        assert(count == 0 || ts < transitions[0].ts);
+    }
+
+    if (tz64_next_transition(tz, ts, &next) != NULL) {
+        assert(ts < next.ts);
+        assert_info_eq(&next.before, &info);
+    } else {
+        assert(errno == ENOENT);
+        assert(count == 0 || transitions[count - 1].ts <= ts);
+    }
+}
+
+
+static void check_tz(const char *name)
+{
+    struct tz64 *tz = tz64_alloc(name);
+    assert(tz != NULL);
+
+    // Collect the transitions from the iterator.
+    struct tz64_transition_iter iter;
+    tz64_transition_iter_init(&iter, tz, begin_ts, end_ts);
+    size_t count = 0;
+    while (tz64_transition_iter_next(&iter, &transitions[count]) != NULL) {
+        assert(count < MAX_TRANSITIONS);
+        assert(begin_ts <= transitions[count].ts && transitions[count].ts < end_ts);
+        assert(count == 0 || transitions[count - 1].ts < transitions[count].ts);
+        count++;
+    }
+    assert(tz64_transition_iter_next(&iter, &transitions[count]) == NULL);
+
+    // Zones with daylight saving time rules keep going to the end.
+    if (tz->extra_ts != NULL) {
+        assert(count > 2 * 400);
+        assert(transitions[count - 1].ts > end_ts - INT64_C(366) * 86400);
+    }
+
+    // Each transition should be found from either side.
+    for (size_t i = 0; i < count; i++) {
+        const struct tz64_transition *t = &transitions[i];
+        check_ts(tz, t->ts - 1, count);
+        check_ts(tz, t->ts, count);
+
+        struct tz64_transition trans;
+        assert(tz64_next_transition(tz, t->ts - 1, &trans) == &trans);
+        assert_transition_eq(&trans, t);
+        assert(tz64_prev_transition(tz, t->ts, &trans) == &trans);
+        assert_transition_eq(&trans, t);
+
+        // Anything up to the next transition should find this one.
+        int64_t next_ts = (i + 1 < count) ? transitions[i + 1].ts : t->ts + 86400;
+        int64_t mid = t->ts + (next_ts - t->ts) / 2;
+        assert(tz64_prev_transition(tz, mid, &trans) == &trans);
+        assert_transition_eq(&trans, t);
+        if (i + 1 < count) {
+            assert(tz64_next_transition(tz, mid, &trans) == &trans);
+            assert_transition_eq(&trans, &transitions[i + 1]);
+        }
+    }
+
+    // Check every day in between.
+    for (int64_t ts = begin_ts; ts < end_ts; ts += 86400 + 997) {
+        check_ts(tz, ts, count);
+    }
+
+    // A sub-range should see a subset of the same transitions.
+    if (count > 4) {
+        tz64_transition_iter_init(&iter, tz, transitions[1].ts, transitions[3].ts);
+        struct tz64_transition trans;
+        assert(tz64_transition_iter_next(&iter, &trans) == &trans);
+        assert_transition_eq(&trans, &transitions[1]);
+        assert(tz64_transition_iter_next(&iter, &trans) == &trans);
+        assert_transition_eq(&trans, &transitions[2]);
+        assert(tz64_transition_iter_next(&iter, &trans) == NULL);
+    }
+
+    tz64_free(tz);
+}
+
+
+int main(int argc, char *argv[])
+{
+    for (int i = 0; tz_names[i] != NULL; i++) {
+        check_tz(tz_names[i]);
+    }
+
+    return 0;
+}
@@ -24,6 +24,9 @@
 #include <time.h>
 #include <string.h>
 #include <inttypes.h>
+#include <assert.h>
+#include <tz64.h>
+#include <tz64file.h>
 #include "utils.h"
 
 void init_tm(struct tm *tm, int year, int month, int day, int hour, int min, int sec, int isdst)
@@ -86,5 +89,101 @@ void assert_tm(int64_t ts,
     assert_tm_eq(ts, &tm, actual);
 }
 
+
+void fill_timestamps(const struct tz64 *tz, int64_t *timestamps, size_t count)
+{
+    size_t n = 0;
+    for (uint32_t i = 1; i < tz->ts_count && n + 2 < count / 2; i++) {
+        timestamps[n++] = tz->timestamps[i] - 1;
+        timestamps[n++] = tz->timestamps[i];
+    }
+
+    for (uint32_t i = 1; i < tz->leap_count && n + 2 < count / 2; i++) {
+        timestamps[n++] = tz->leap_ts[i];
+        timestamps[n++] = tz->leap_ts[i] + 1;
+    }
+
+    // Include some times far enough from the present to take the
+    // slow path through the batch functions.
+    static const int64_t far[] = {
+        INT64_C(-100000000000000), INT64_C(-150000000000), INT64_C(-138000000000),
+        INT64_C(-62162017821), INT64_C(275000000000), INT64_C(276000000000),
+        INT64_C(100000000000000)
+    };
+    for (size_t i = 0; i < sizeof(far) / sizeof(far[0]) && n < count; i++) {
+        timestamps[n++] = far[i];
+    }
+
+    uint64_t x = 2463534242;
+    while (n < count) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        timestamps[n++] = (int64_t)(x % INT64_C(40000000000)) - INT64_C(10000000000);
+    }
+}
+
+
+struct tz64 *load_reference(const char *name, int64_t *timestamps, struct tm *expected, size_t count)
+{
+    struct tz64 *tz = tz64_alloc(name);
+    assert(tz != NULL);
+    fill_timestamps(tz, timestamps, count);
+    for (size_t i = 0; i < count; i++) {
+        memset(&expected[i], 0, sizeof(expected[i]));
+        assert(tz64_ts_to_tm(tz, timestamps[i], &expected[i]) == &expected[i]);
+    }
+
+    return tz;
+}
+
+
+void check_same(const struct tz64 *expected_tz, const struct tz64 *actual_tz)
+{
+    uint64_t x = 2463534242;
+    for (uint32_t i = 0; i < 4096; i++) {
+        int64_t ts;
+        if (i < 2 * (expected_tz->ts_count - 1)) {
+            ts = expected_tz->timestamps[i / 2 + 1] - (i & 1);
+        } else {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            ts = (int64_t)(x % INT64_C(40000000000)) - INT64_C(10000000000);
+        }
+
+        struct tm expected, actual;
+        memset(&expected, 0, sizeof(expected));
+        memset(&actual, 0, sizeof(actual));
+        assert(tz64_ts_to_tm(expected_tz, ts, &expected) == &expected);
+        assert(tz64_ts_to_tm(actual_tz, ts, &actual) == &actual);
+        assert_tm_eq(ts, &expected, &actual);
+
+        expected.tm_isdst = actual.tm_isdst = -1;
+        assert(tz64_tm_to_ts(actual_tz, &actual) == tz64_tm_to_ts(expected_tz, &expected));
+        assert_tm_eq(ts, &expected, &actual);
+    }
+}
+
+
+char *read_zone_file(const char *name, size_t *size)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "/usr/share/zoneinfo/%s", name);
+    FILE *file = fopen(path, "rb");
+    assert(file != NULL);
+    assert(fseek(file, 0, SEEK_END) == 0);
+    const long len = ftell(file);
+    assert(len > 0);
+    rewind(file);
+
+    char *data = malloc(len);
+    assert(data != NULL);
+    assert(fread(data, len, 1, file) == 1);
+    fclose(file);
+    *size = len;
+    return data;
+}
+
 ////////////////////////////////////////////////////////////////////////
 // End of utils.c
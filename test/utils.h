@@ -20,6 +20,7 @@
 // WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stddef.h>
+#include <inttypes.h>
 #include <time.h>
 #include <string.h>
 #include <assert.h>
@@ -70,5 +71,23 @@ void assert_tm(int64_t ts,
                int utoff, const char *desig,
                const struct tm *actual);
 
+struct tz64;
+
+// Fill timestamps with the seconds around a time zone's transitions
+// and leap seconds, some far from the present, and pseudo-random
+// times from the distant past to the distant future.
+void fill_timestamps(const struct tz64 *tz, int64_t *timestamps, size_t count);
+
+// Load a time zone the ordinary way, fill timestamps for it and
+// convert them to give the expected broken-down times.
+struct tz64 *load_reference(const char *name, int64_t *timestamps, struct tm *expected, size_t count);
+
+// Check that two time zones convert timestamps around each transition
+// and at pseudo-random times the same way, in both directions.
+void check_same(const struct tz64 *expected_tz, const struct tz64 *actual_tz);
+
+// Read a time zone's file into memory from malloc.
+char *read_zone_file(const char *name, size_t *size);
+
 ////////////////////////////////////////////////////////////////////////
 // End of utils.h
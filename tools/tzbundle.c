@@ -0,0 +1,294 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Compile a directory of TZif files into a bundle for tz64_bundle_open.
+
+// For nftw and realpath.
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <string.h>
+#include <errno.h>
+#include <tz64.h>
+#include <tz64file.h>
+#include <constants.h>
+
+const char *progname;
+
+static const char magic[] = "TZif";
+
+// The time zone files found so far: their names relative to the
+// directory, the time zones loaded from them, and the files they came
+// from, so that links to the same file share a time zone.
+static const char **names;
+static const struct tz64 **zones;
+static dev_t *devs;
+static ino_t *inos;
+static size_t zone_count;
+static size_t zone_alloc;
+
+// Symbolic links to directories, such as posix -> ., as the names
+// they give and the directories they point to.
+static char **dir_names;
+static char **dir_paths;
+static size_t dir_count;
+
+// The directory being walked and the name it's found under.
+static size_t walk_len;
+static const char *walk_prefix;
+static struct tz64_options opts;
+static bool verbose;
+
+
+static void set_progname(const char *arg0)
+{
+    const char *p = strrchr(arg0, '/');
+    progname = (p != NULL) ? p + 1 : arg0;
+}
+
+
+static void usage()
+{
+    fprintf(stderr, "usage: %s [-r] [-v] [-d zoneinfo-dir] bundle\n", progname);
+    fprintf(stderr, "usage: %s -h\n", progname);
+    fprintf(stderr, "    -d dir    compile the time zones in dir [%s]\n", ZONE_DIR);
+    fprintf(stderr, "    -r        expand the daylight saving rules of each time zone\n");
+    fprintf(stderr, "    -v        list the time zones as they're added\n");
+}
+
+
+// Returns true if the file at path starts with the TZif magic.
+static bool is_tzfile(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[sizeof(magic) - 1];
+    const ssize_t len = read(fd, buffer, sizeof(buffer));
+    (void)close(fd);
+    return len == sizeof(buffer) && memcmp(buffer, magic, sizeof(buffer)) == 0;
+}
+
+
+static void *grow(void *array, size_t size)
+{
+    void *res = realloc(array, zone_alloc * size);
+    if (res == NULL) {
+        fprintf(stderr, "%s: error: out of memory\n", progname);
+        exit(1);
+    }
+
+    return res;
+}
+
+
+// Returns the name of a file relative to the directory being walked,
+// including the name the directory itself is found under.
+static char *file_name(const char *path)
+{
+    const char *name = path + walk_len;
+    while (*name == '/') {
+        name++;
+    }
+
+    char *res = malloc(strlen(walk_prefix) + strlen(name) + 1);
+    if (res == NULL) {
+        fprintf(stderr, "%s: error: out of memory\n", progname);
+        exit(1);
+    }
+
+    strcpy(res, walk_prefix);
+    strcat(res, name);
+    return res;
+}
+
+
+static int add_file(const char *path, const struct stat *lstatbuf, int flag, struct FTW *ftw)
+{
+    (void)ftw;
+
+    // Symbolic links to files are followed here, and those to
+    // directories once the walk is done, rather than letting nftw
+    // follow them: it won't enter a directory twice, so a link back
+    // to the top would otherwise hide the real names.
+    struct stat statbuf;
+    if (flag == FTW_SL) {
+        if (stat(path, &statbuf) != 0) {
+            return 0;
+        }
+
+        if (S_ISDIR(statbuf.st_mode)) {
+            if (walk_prefix[0] == '\0') {
+                dir_names = realloc(dir_names, (dir_count + 1) * sizeof(dir_names[0]));
+                dir_paths = realloc(dir_paths, (dir_count + 1) * sizeof(dir_paths[0]));
+                if (dir_names == NULL || dir_paths == NULL) {
+                    fprintf(stderr, "%s: error: out of memory\n", progname);
+                    exit(1);
+                }
+
+                dir_paths[dir_count] = realpath(path, NULL);
+                if (dir_paths[dir_count] != NULL) {
+                    dir_names[dir_count++] = file_name(path);
+                }
+            }
+
+            return 0;
+        }
+    } else if (flag == FTW_F) {
+        statbuf = *lstatbuf;
+    } else {
+        return 0;
+    }
+
+    if (!S_ISREG(statbuf.st_mode) || !is_tzfile(path)) {
+        return 0;
+    }
+
+    if (zone_count == zone_alloc) {
+        zone_alloc = (zone_alloc == 0) ? 1024 : zone_alloc * 2;
+        names = grow(names, sizeof(names[0]));
+        zones = grow(zones, sizeof(zones[0]));
+        devs = grow(devs, sizeof(devs[0]));
+        inos = grow(inos, sizeof(inos[0]));
+    }
+
+    // Share the time zone of any earlier link to the same file.
+    const struct tz64 *tz = NULL;
+    for (size_t i = 0; i < zone_count; i++) {
+        if (devs[i] == statbuf.st_dev && inos[i] == statbuf.st_ino) {
+            tz = zones[i];
+            break;
+        }
+    }
+
+    if (tz == NULL) {
+        tz = tz64_alloc_with(path, &opts);
+        if (tz == NULL) {
+            fprintf(stderr, "%s: warning: skipping %s: %s\n", progname, path, strerror(errno));
+            return 0;
+        }
+    }
+
+    names[zone_count] = file_name(path);
+    zones[zone_count] = tz;
+    devs[zone_count] = statbuf.st_dev;
+    inos[zone_count] = statbuf.st_ino;
+    zone_count++;
+
+    if (verbose) {
+        printf("%s\n", names[zone_count - 1]);
+    }
+
+    return 0;
+}
+
+
+// Add the time zone files under a directory, naming them after prefix.
+static void walk(const char *path, const char *prefix)
+{
+    walk_len = strlen(path);
+    walk_prefix = prefix;
+    if (nftw(path, add_file, 32, FTW_PHYS) != 0) {
+        fprintf(stderr, "%s: error: failed to read %s: %s\n", progname, path, strerror(errno));
+        exit(1);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    set_progname(argv[0]);
+    tz64_options_init(&opts);
+
+    const char *root = ZONE_DIR;
+    int choice;
+    while ((choice = getopt(argc, argv, "d:hrv")) != -1) {
+        switch (choice) {
+        case 'd':
+            root = optarg;
+            break;
+
+        case 'h':
+            usage();
+            exit(0);
+
+        case 'r':
+            opts.expand_rules = 1;
+            break;
+
+        case 'v':
+            verbose = true;
+            break;
+
+        case '?':
+            usage();
+            exit(1);
+
+        default:
+            abort();
+        }
+    }
+
+    if (optind + 1 != argc) {
+        usage();
+        exit(1);
+    }
+
+    // Find and load every time zone file under the directory, giving
+    // symbolic links names of their own.
+    // The paths must be absolute for tz64_alloc to read them as paths.
+    char *abs_root = realpath(root, NULL);
+    if (abs_root == NULL) {
+        fprintf(stderr, "%s: error: failed to read %s: %s\n", progname, root, strerror(errno));
+        exit(1);
+    }
+
+    walk(abs_root, "");
+
+    // Then those under links to directories, one level deep.
+    for (size_t i = 0; i < dir_count; i++) {
+        char *prefix = malloc(strlen(dir_names[i]) + 2);
+        if (prefix == NULL) {
+            fprintf(stderr, "%s: error: out of memory\n", progname);
+            exit(1);
+        }
+
+        strcpy(prefix, dir_names[i]);
+        strcat(prefix, "/");
+        walk(dir_paths[i], prefix);
+    }
+
+    if (tz64_bundle_write(argv[optind], names, zones, zone_count) != 0) {
+        fprintf(stderr, "%s: error: failed to write %s: %s\n", progname, argv[optind], strerror(errno));
+        exit(1);
+    }
+
+    exit(0);
+}
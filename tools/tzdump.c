@@ -494,6 +494,14 @@ static void dump_cooked_file(const char *path)
                offset->isdst ? "dst" : "std");
     }
 
+    if (tz->buckets.count != 0) {
+        printf("-- index --\n");
+        printf("begin=%" PRId64 " (%s UTC)\n", tz->buckets.begin, format_utc(tz->buckets.begin));
+        printf("end=%" PRId64 " (%s UTC)\n", tz->buckets.end, format_utc(tz->buckets.end));
+        printf("buckets=%u of %" PRId64 " seconds\n", tz->buckets.count, INT64_C(1) << tz->buckets.shift);
+        printf("bytes=%zu\n", tz->buckets.count * 2 * sizeof(uint16_t));
+    }
+
     if (tz->leap_count != 0) {
         printf("-- leap seconds --\n");
         for (uint32_t i = 1; i < tz->leap_count; i++) {
@@ -0,0 +1,403 @@
+// Copyright 2022 Ted Phelps
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+// Generate C source for time zones compiled into the library.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <tz64.h>
+#include <tz64file.h>
+#include <constants.h>
+
+const char *progname;
+
+// The generator is itself built without any time zones compiled in.
+const struct tz_embedded tz_embedded_zones[1];
+const size_t tz_embedded_count = 0;
+
+enum kind {
+    K_INT64,
+    K_INT32,
+    K_UINT32,
+    K_UINT16,
+    K_UINT8,
+    K_CHAR,
+    K_OFFSET
+};
+
+// The tables a time zone points to.  Some pointers are set a few
+// elements into their tables so that they can be indexed from -2.
+struct member {
+    const char *name;
+    size_t offset;
+    enum kind kind;
+    size_t elem_size;
+    const char *type;
+    size_t prefix;
+};
+
+#define MEMBER(name, kind, type, prefix) \
+    { #name, offsetof(struct tz64, name), kind, sizeof(type), #type, prefix }
+
+static const struct member members[] = {
+    MEMBER(timestamps, K_INT64, int64_t, 0),
+    MEMBER(local_edges, K_INT64, int64_t, 0),
+    MEMBER(offset_map, K_UINT8, uint8_t, 2),
+    MEMBER(offsets, K_OFFSET, struct tz_offset, 0),
+    MEMBER(leap_ts, K_INT64, int64_t, 0),
+    MEMBER(rev_leap_ts, K_INT64, int64_t, 0),
+    MEMBER(leap_secs, K_INT32, int32_t, 0),
+    MEMBER(desig, K_CHAR, char, 0),
+    MEMBER(extra_ts, K_INT32, int32_t, 0),
+    MEMBER(extra_cycle, K_INT32, int32_t, 2),
+    MEMBER(ts_eytz.values, K_INT64, int64_t, 0),
+    MEMBER(ts_eytz.rank, K_UINT32, uint32_t, 0),
+    MEMBER(leap_eytz.values, K_INT64, int64_t, 0),
+    MEMBER(leap_eytz.rank, K_UINT32, uint32_t, 0),
+    MEMBER(rev_leap_eytz.values, K_INT64, int64_t, 0),
+    MEMBER(rev_leap_eytz.rank, K_UINT32, uint32_t, 0),
+    MEMBER(buckets.fwd, K_UINT16, uint16_t, 0),
+    MEMBER(buckets.rev, K_UINT16, uint16_t, 0),
+};
+
+#define MEMBER_COUNT (sizeof(members) / sizeof(members[0]))
+
+struct named_zone {
+    const char *name;
+    size_t zone;
+};
+
+
+static void set_progname(const char *arg0)
+{
+    const char *p = strrchr(arg0, '/');
+    progname = (p != NULL) ? p + 1 : arg0;
+}
+
+
+static void usage()
+{
+    fprintf(stderr, "usage: %s [-d zoneinfo-dir] output [zone ...]\n", progname);
+    fprintf(stderr, "usage: %s -h\n", progname);
+    fprintf(stderr, "    -d dir    read the time zones from dir [%s]\n", ZONE_DIR);
+}
+
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(((const struct named_zone *)a)->name, ((const struct named_zone *)b)->name);
+}
+
+
+static const char *member_pointer(const struct tz64 *tz, const struct member *member)
+{
+    const char *p;
+    memcpy(&p, (const char *)tz + member->offset, sizeof(p));
+    return p;
+}
+
+
+// Turn a member's name into part of a C identifier.
+static void write_ident(FILE *out, size_t zone, const struct member *member)
+{
+    fprintf(out, "zone_%zu_", zone);
+    for (const char *p = member->name; *p != '\0'; p++) {
+        fputc((*p == '.') ? '_' : *p, out);
+    }
+}
+
+
+static void write_value(FILE *out, const struct member *member, const char *p)
+{
+    switch (member->kind) {
+    case K_INT64: {
+        int64_t value;
+        memcpy(&value, p, sizeof(value));
+        if (value == INT64_MIN) {
+            fprintf(out, "INT64_MIN");
+        } else if (value == INT64_MAX) {
+            fprintf(out, "INT64_MAX");
+        } else {
+            fprintf(out, "INT64_C(%" PRId64 ")", value);
+        }
+        break;
+    }
+
+    case K_INT32: {
+        int32_t value;
+        memcpy(&value, p, sizeof(value));
+        if (value == INT32_MIN) {
+            fprintf(out, "INT32_MIN");
+        } else {
+            fprintf(out, "%" PRId32, value);
+        }
+        break;
+    }
+
+    case K_UINT32: {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        fprintf(out, "%" PRIu32 "u", value);
+        break;
+    }
+
+    case K_UINT16: {
+        uint16_t value;
+        memcpy(&value, p, sizeof(value));
+        fprintf(out, "%" PRIu16, value);
+        break;
+    }
+
+    case K_UINT8:
+        fprintf(out, "%u", (unsigned char)*p);
+        break;
+
+    case K_CHAR:
+        fprintf(out, "%d", (signed char)*p);
+        break;
+
+    case K_OFFSET: {
+        struct tz_offset value;
+        memcpy(&value, p, sizeof(value));
+        fprintf(out, "{ %d, %u, %u }", (int)value.utoff, (unsigned)value.isdst, (unsigned)value.desig);
+        break;
+    }
+    }
+}
+
+
+// Write out the tables of a time zone loaded from a file, followed by
+// the time zone itself.  Each table runs from where its pointer (less
+// any prefix) points to where the next one starts, so that whatever a
+// lookup might read of the loaded time zone is there in the copy too.
+// Fails if a pointer lies outside the time zone's block, as those of
+// time zones made from POSIX TZ strings do.
+static int write_zone(FILE *out, size_t zone, const struct tz64 *tz)
+{
+    const char *base = (const char *)tz;
+    const char *block_end = base + tz->size;
+    const char *starts[MEMBER_COUNT];
+    for (size_t i = 0; i < MEMBER_COUNT; i++) {
+        const char *p = member_pointer(tz, &members[i]);
+        starts[i] = (p == NULL) ? NULL : p - members[i].prefix * members[i].elem_size;
+        if (p != NULL && (starts[i] < base + sizeof(struct tz64) || p > block_end)) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    bool present[MEMBER_COUNT];
+    for (size_t i = 0; i < MEMBER_COUNT; i++) {
+        present[i] = false;
+        if (starts[i] == NULL) {
+            continue;
+        }
+
+        // The bucket tables are the only ones that can be empty.
+        size_t count;
+        if (members[i].offset == offsetof(struct tz64, buckets.fwd) ||
+            members[i].offset == offsetof(struct tz64, buckets.rev)) {
+            count = tz->buckets.count;
+        } else {
+            const char *end = block_end;
+            for (size_t j = 0; j < MEMBER_COUNT; j++) {
+                if (starts[j] != NULL && starts[j] > starts[i] && starts[j] < end) {
+                    end = starts[j];
+                }
+            }
+
+            count = (end - starts[i]) / members[i].elem_size;
+        }
+
+        if (count <= members[i].prefix) {
+            continue;
+        }
+
+        present[i] = true;
+        fprintf(out, "static const %s ", members[i].type);
+        write_ident(out, zone, &members[i]);
+        fprintf(out, "[%zu] = {", count);
+
+        const size_t per_line = (members[i].kind == K_INT64 || members[i].kind == K_OFFSET) ? 4 : 8;
+        for (size_t k = 0; k < count; k++) {
+            fprintf(out, (k % per_line == 0) ? "\n    " : " ");
+            write_value(out, &members[i], starts[i] + k * members[i].elem_size);
+            fputc(',', out);
+        }
+        fprintf(out, "\n};\n\n");
+    }
+
+    fprintf(out, "static const struct tz64 zone_%zu = {\n", zone);
+    fprintf(out, "    .ts_count = %" PRIu32 ",\n", tz->ts_count);
+    fprintf(out, "    .leap_count = %" PRIu32 ",\n", tz->leap_count);
+    for (size_t i = 0; i < MEMBER_COUNT; i++) {
+        if (present[i]) {
+            fprintf(out, "    .%s = &", members[i].name);
+            write_ident(out, zone, &members[i]);
+            fprintf(out, "[%zu],\n", members[i].prefix);
+        }
+    }
+
+    fprintf(out, "    .buckets.begin = INT64_C(%" PRId64 "),\n", tz->buckets.begin);
+    fprintf(out, "    .buckets.end = INT64_C(%" PRId64 "),\n", tz->buckets.end);
+    fprintf(out, "    .buckets.count = %" PRIu32 ",\n", tz->buckets.count);
+    fprintf(out, "    .buckets.shift = %" PRIu32 ",\n", tz->buckets.shift);
+    fprintf(out, "};\n\n");
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    set_progname(argv[0]);
+
+    const char *root = ZONE_DIR;
+    int choice;
+    while ((choice = getopt(argc, argv, "d:h")) != -1) {
+        switch (choice) {
+        case 'd':
+            root = optarg;
+            break;
+
+        case 'h':
+            usage();
+            exit(0);
+
+        case '?':
+            usage();
+            exit(1);
+
+        default:
+            abort();
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
+        exit(1);
+    }
+
+    const char *output = argv[optind++];
+    const size_t name_count = argc - optind;
+    struct named_zone *names = calloc(name_count + 1, sizeof(struct named_zone));
+    const struct tz64 **zones = calloc(name_count + 1, sizeof(struct tz64 *));
+    const char **zone_names = calloc(name_count + 1, sizeof(char *));
+    dev_t *devs = calloc(name_count + 1, sizeof(dev_t));
+    ino_t *inos = calloc(name_count + 1, sizeof(ino_t));
+    if (names == NULL || zones == NULL || zone_names == NULL || devs == NULL || inos == NULL) {
+        fprintf(stderr, "%s: error: out of memory\n", progname);
+        exit(1);
+    }
+
+    // Load each time zone, sharing one between names for the same
+    // file.  Paths are built here rather than left to tz64_alloc so
+    // that names are never taken for POSIX TZ strings.
+    size_t zone_count = 0;
+    for (size_t i = 0; i < name_count; i++) {
+        const char *name = argv[optind + i];
+        char path[1024];
+        struct stat statbuf;
+        if (snprintf(path, sizeof(path), "%s/%s", root, name) >= (int)sizeof(path) ||
+            stat(path, &statbuf) != 0) {
+            fprintf(stderr, "%s: error: no time zone file for %s\n", progname, name);
+            exit(1);
+        }
+
+        names[i].name = name;
+        names[i].zone = zone_count;
+        for (size_t j = 0; j < zone_count; j++) {
+            if (devs[j] == statbuf.st_dev && inos[j] == statbuf.st_ino) {
+                names[i].zone = j;
+                break;
+            }
+        }
+
+        if (names[i].zone == zone_count) {
+            char abs_path[1024];
+            if (realpath(path, abs_path) == NULL ||
+                (zones[zone_count] = tz64_alloc(abs_path)) == NULL) {
+                fprintf(stderr, "%s: error: failed to load %s: %s\n", progname, name, strerror(errno));
+                exit(1);
+            }
+
+            zone_names[zone_count] = name;
+            devs[zone_count] = statbuf.st_dev;
+            inos[zone_count] = statbuf.st_ino;
+            zone_count++;
+        }
+    }
+
+    qsort(names, name_count, sizeof(names[0]), compare_names);
+    for (size_t i = 1; i < name_count; i++) {
+        if (strcmp(names[i - 1].name, names[i].name) == 0) {
+            fprintf(stderr, "%s: error: %s is listed twice\n", progname, names[i].name);
+            exit(1);
+        }
+    }
+
+    FILE *out = fopen(output, "w");
+    if (out == NULL) {
+        fprintf(stderr, "%s: error: failed to open %s: %s\n", progname, output, strerror(errno));
+        exit(1);
+    }
+
+    fprintf(out, "// Generated by %s; do not edit.\n\n", progname);
+    fprintf(out, "#include <stddef.h>\n");
+    fprintf(out, "#include <inttypes.h>\n");
+    fprintf(out, "#include \"tz64file.h\"\n\n");
+
+    for (size_t i = 0; i < zone_count; i++) {
+        if (write_zone(out, i, zones[i]) != 0) {
+            fprintf(stderr, "%s: error: failed to embed %s: %s\n", progname, zone_names[i], strerror(errno));
+            (void)fclose(out);
+            (void)unlink(output);
+            exit(1);
+        }
+    }
+
+    // There must be at least one element, even if there are no time
+    // zones.
+    fprintf(out, "const struct tz_embedded tz_embedded_zones[%zu] = {\n", (name_count == 0) ? 1 : name_count);
+    for (size_t i = 0; i < name_count; i++) {
+        fprintf(out, "    { \"%s\", &zone_%zu },\n", names[i].name, names[i].zone);
+    }
+    if (name_count == 0) {
+        fprintf(out, "    { NULL, NULL },\n");
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "const size_t tz_embedded_count = %zu;\n", name_count);
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "%s: error: failed to write %s: %s\n", progname, output, strerror(errno));
+        (void)unlink(output);
+        exit(1);
+    }
+
+    exit(0);
+}